@@ -24,6 +24,7 @@
 #include "memory.h"
 #include "net.h"
 #include "lookup.h"
+#include "dns.h"
 
 #ifdef BSD_FEATURES
 /* vfork() is not POSIX. */
@@ -197,7 +198,7 @@ void op_conn_assign(void)
       return;
     } 
     if (cur_conn) {
-      cur_conn->dbref = args[0].u.dbref;
+      connection_assign(cur_conn, args[0].u.dbref);
       pop(1);
       push_int(1);
     } else {
@@ -563,13 +564,17 @@ void op_resume(void) {
   Data *args;
   int nargs;
   long tid;
+  VMState *vm;
 
   if (!func_init_1_or_2(&args, &nargs, INTEGER, 0))
     return;
   CHECK_ADMIN
   tid = args[0].u.val;
-  if (!task_lookup(tid)) {
+  vm = task_lookup(tid);
+  if (!vm) {
     cthrow(type_id, "No such task");
+  } else if (vm->dns_wait) {
+    cthrow(perm_id, "Task is waiting for a name lookup");
   } else {
     if (nargs == 1) 
       task_resume(tid, NULL);
@@ -615,14 +620,20 @@ void op_hostname(void)
     Data *args;
     String *r;
 
-    /* Accept a port number. */
+    /* Accept an address. */
     if (!func_init_1(&args, STRING))
         return;
 
-    r = hostname(args[0].u.str->s);
+    r = dns_lookup(string_chars(args[0].u.str), 1);
 
     pop(1);
-    push_string(r);
+    if (r) {
+	push_string(r);
+	string_discard(r);
+    } else {
+	/* dns_deliver() will resume us with the name. */
+	task_wait_dns();
+    }
 }
 
 void op_ip(void)
@@ -634,10 +645,16 @@ void op_ip(void)
     if (!func_init_1(&args, STRING))
         return;
 
-    r = ip(args[0].u.str->s);
+    r = dns_lookup(string_chars(args[0].u.str), 0);
 
     pop(1);
-    push_string(r);
+    if (r) {
+	push_string(r);
+	string_discard(r);
+    } else {
+	/* dns_deliver() will resume us with the address. */
+	task_wait_dns();
+    }
 }
 
 void op_callers(void)
@@ -170,6 +170,39 @@ void op_splice_add(void)
     }
 }
 
+/* Effects: Adds a chain of operands onto the variable at its head, for
+ *	    var = var + e1 + ... + ek;.  If they are all strings or all lists,
+ *	    appends them in one go, so that the variable's value is extended
+ *	    in place instead of being copied for the first addition, and
+ *	    jumps to the assignment.  Otherwise pops e1..ek and falls through
+ *	    to code which evaluates and adds them one at a time. */
+void op_add_tail(void)
+{
+    int count = cur_frame->opcodes[cur_frame->pc + 1];
+    Data *d1 = &stack[stack_pos - count - 1], *d;
+
+    for (d = d1 + 1; d < &stack[stack_pos]; d++) {
+	if (d->type != d1->type)
+	    break;
+    }
+
+    if (d < &stack[stack_pos] || (d1->type != STRING && d1->type != LIST)) {
+	pop(count);
+	cur_frame->pc += 2;
+	return;
+    }
+
+    cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+    anticipate_assignment();
+    for (d = d1 + 1; d < &stack[stack_pos]; d++) {
+	if (d1->type == STRING)
+	    d1->u.str = string_add(d1->u.str, d->u.str);
+	else
+	    d1->u.list = list_append(d1->u.list, d->u.list);
+    }
+    pop(count);
+}
+
 /* Effects: If the top two values on the stack are integers, pops them and
  *	    pushes their difference. */
 void op_subtract(void)
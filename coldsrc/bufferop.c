@@ -37,6 +37,7 @@ void op_buffer_append(void)
 
     if (!func_init_2(&args, BUFFER, BUFFER))
 	return;
+    anticipate_assignment();
     args[0].u.buffer = buffer_append(args[0].u.buffer, args[1].u.buffer);
     pop(1);
 }
@@ -50,6 +51,7 @@ void op_buffer_replace(void)
 	return;
     pos = args[1].u.val - 1;
     if (check_index(pos, buffer_len(args[0].u.buffer), args)) {
+      anticipate_assignment();
       args[0].u.buffer = buffer_replace(args[0].u.buffer, pos, args[1].u.val);
       pop(2);
     }
@@ -61,6 +63,7 @@ void op_buffer_add(void)
 
     if (!func_init_2(&args, BUFFER, INTEGER))
 	return;
+    anticipate_assignment();
     args[0].u.buffer = buffer_add(args[0].u.buffer, args[1].u.val);
     pop(1);
 }
@@ -79,6 +82,7 @@ void op_buffer_truncate(void)
 		  range_id, "Position (%d) is greater than buffer length (%d).",
 		  pos + 1, buffer_len(args[0].u.buffer));
     } else {
+      anticipate_assignment();
       args[0].u.buffer = buffer_truncate(args[0].u.buffer, pos);
       pop(1);
     }
@@ -13,14 +13,17 @@ struct string {
     int len;
     int size;
     int refs; 
-    regexp *reg;
-    char s[1];
+    int interned;		/* Nonzero if in the table of short strings. */
+    String *base;		/* For a view, the string whose text it shares. */
+    char *s;			/* base->s for a view, or else store. */
+    char store[1];
 };
 
 /* string.c */
 String *string_new(int len);
 String *string_empty(int size);
 String *string_from_chars(char *s, int len);
+String *string_intern(char *s, int len);
 String *string_of_char(int c, int len);
 String *string_dup(String *str);
 int string_length(String *str);
@@ -38,6 +41,7 @@ String *string_substring(String *str, int start, int len);
 String *string_uppercase(String *str);
 String *string_lowercase(String *str);
 regexp *string_regexp(String *str);
+void string_regexp_stats(long *hits, long *misses, int *cached);
 void string_discard(String *str);
 String *string_parse(char **sptr);
 String *string_add_unparsed(String *str, char *s, int len);
@@ -24,6 +24,21 @@
 #define JUMP_TABLE_START	(128 - MALLOC_DELTA)
 #define MAX_VARS		128
 
+/* Switch statements with at least this many case values, all of them
+ * literals, dispatch through a table instead of trying each case. */
+#define SWITCH_TABLE_MIN	4
+
+/* Assignments of the form var = var + e1 + ... + ek, with at least this
+ * many operands added on, append to var in one step (see op_add_tail()). */
+#define ADD_TAIL_MIN		2
+
+static void fold_stmt_list(Stmt_list *stmt_list);
+static void fold_stmt(Stmt *stmt);
+static void fold_expr_list(Expr_list *expr_list);
+static void fold_expr(Expr *expr);
+static int constant_aggregate(Expr *expr);
+static int switch_table_cases(Case_list *cases);
+static int add_tail_operands(char *var, Expr *value);
 static void compile_stmt_list(Stmt_list *stmt_list, int loop, int catch_level);
 static void compile_stmt(Stmt *stmt, int loop, int catch_level);
 static void compile_cases(Case_list *cases, int loop, int catch_level,
@@ -31,6 +46,8 @@ static void compile_cases(Case_list *cases, int loop, int catch_level,
 static void compile_case_values(Expr_list *values, int body_dest);
 static void compile_expr_list(Expr_list *expr_list);
 static void compile_expr(Expr *expr);
+static void compile_aggregate(Expr *expr);
+static void compile_add_tail(Expr *expr, int count, int add);
 static int find_local_var(char *id);
 static void check_instr_buf(int pos);
 static void code(long val);
@@ -54,6 +71,10 @@ static Prog *the_prog;
 /* Keep track of the number of error lists we'll need. */
 static int num_error_lists;
 
+/* The number of constant aggregates coded so far, and whether we're inside
+ * one. */
+static int num_aggregates, in_aggregate;
+
 Pile *compiler_pile;			/* Temporary storage pile. */
 
 /* Requires: Shouldn't be called twice.
@@ -586,11 +607,14 @@ Method *generate_method(Prog *prog, Object *object)
 {
     /* Reset the error list counter to 0. */
     num_error_lists = 0;
+    num_aggregates = 0;
+    in_aggregate = 0;
 
     /* Compile the code into instr_buf. */
     instr_loc = 0;
     jump_loc = 0;
     the_prog = prog;
+    fold_stmt_list(prog->stmts);
     compile_stmt_list(prog->stmts, -1, 0);
 
     /* If we have no errors, call final_pass() to make a method. */
@@ -602,6 +626,246 @@ Method *generate_method(Prog *prog, Object *object)
     return NULL;
 }
 
+/* Modifies: Expressions in stmt_list.
+ * Effects: Folds the constant expressions in the statements in stmt_list. */
+static void fold_stmt_list(Stmt_list *stmt_list)
+{
+    for (; stmt_list; stmt_list = stmt_list->next)
+	fold_stmt(stmt_list->stmt);
+}
+
+/* Modifies: Expressions in stmt.
+ * Effects: Folds the constant expressions in stmt. */
+static void fold_stmt(Stmt *stmt)
+{
+    Case_list *cases;
+
+    switch (stmt->type) {
+
+      case EXPR:
+      case RETURN_EXPR:
+	fold_expr(stmt->u.expr);
+	break;
+
+      case COMPOUND:
+	fold_stmt_list(stmt->u.stmt_list);
+	break;
+
+      case IF:
+	fold_expr(stmt->u.if_.cond);
+	fold_stmt(stmt->u.if_.true);
+	break;
+
+      case IF_ELSE:
+	fold_expr(stmt->u.if_.cond);
+	fold_stmt(stmt->u.if_.true);
+	fold_stmt(stmt->u.if_.false);
+	break;
+
+      case FOR_RANGE:
+	fold_expr(stmt->u.for_range.lower);
+	fold_expr(stmt->u.for_range.upper);
+	fold_stmt(stmt->u.for_range.body);
+	break;
+
+      case FOR_LIST:
+	fold_expr(stmt->u.for_list.list);
+	fold_stmt(stmt->u.for_list.body);
+	break;
+
+      case WHILE:
+	fold_expr(stmt->u.while_.cond);
+	fold_stmt(stmt->u.while_.body);
+	break;
+
+      case SWITCH:
+	fold_expr(stmt->u.switch_.expr);
+	for (cases = stmt->u.switch_.cases; cases; cases = cases->next) {
+	    fold_expr_list(cases->case_entry->values);
+	    fold_stmt_list(cases->case_entry->stmts);
+	}
+	break;
+
+      case CATCH:
+	fold_stmt(stmt->u.ccatch.body);
+	if (stmt->u.ccatch.handler)
+	    fold_stmt(stmt->u.ccatch.handler);
+	break;
+    }
+}
+
+static void fold_expr_list(Expr_list *expr_list)
+{
+    for (; expr_list; expr_list = expr_list->next)
+	fold_expr(expr_list->expr);
+}
+
+/* Modifies: expr, and the expressions below it.
+ * Effects: Replaces negated integer literals with negative ones.  Nothing
+ *	    else is folded: methods are listed by decompiling their code, so
+ *	    folding must not change what the decompiler prints. */
+static void fold_expr(Expr *expr)
+{
+    Expr *left;
+
+    switch (expr->type) {
+
+      case ASSIGN:
+	fold_expr(expr->u.assign.value);
+	break;
+
+      case FUNCTION_CALL:
+	fold_expr_list(expr->u.function.args);
+	break;
+
+      case PASS:
+      case LIST:
+      case DICT:
+      case BUFFER:
+	fold_expr_list(expr->u.args);
+	break;
+
+      case MESSAGE:
+	fold_expr(expr->u.message.to);
+	fold_expr_list(expr->u.message.args);
+	break;
+
+      case EXPR_MESSAGE:
+	fold_expr(expr->u.expr_message.to);
+	fold_expr(expr->u.expr_message.message);
+	fold_expr_list(expr->u.expr_message.args);
+	break;
+
+      case FROB:
+	fold_expr(expr->u.frob.cclass);
+	fold_expr(expr->u.frob.rep);
+	break;
+
+      case INDEX:
+	fold_expr(expr->u.index.list);
+	fold_expr(expr->u.index.offset);
+	break;
+
+      case AND:
+      case OR:
+	fold_expr(expr->u.and.left);
+	fold_expr(expr->u.and.right);
+	break;
+
+      case CONDITIONAL:
+	fold_expr(expr->u.cond.cond);
+	fold_expr(expr->u.cond.true);
+	fold_expr(expr->u.cond.false);
+	break;
+
+      case CRITICAL:
+      case PROPAGATE:
+      case SPLICE:
+	fold_expr(expr->u.expr);
+	break;
+
+      case RANGE:
+	fold_expr(expr->u.range.lower);
+	fold_expr(expr->u.range.upper);
+	break;
+
+      case UNARY:
+	fold_expr(expr->u.unary.expr);
+	left = expr->u.unary.expr;
+	if (expr->u.unary.opcode == NEG && left->type == INTEGER &&
+	    left->u.num > 0) {
+	    expr->type = INTEGER;
+	    expr->u.num = -left->u.num;
+	}
+	break;
+
+      case BINARY:
+	fold_expr(expr->u.binary.left);
+	fold_expr(expr->u.binary.right);
+	break;
+    }
+}
+
+/* Effects: Returns nonzero if expr is a list or dict literal built only from
+ *	    literals, so that every evaluation of it gives the same value. */
+static int constant_aggregate(Expr *expr)
+{
+    Expr_list *args;
+
+    if (expr->type != LIST && expr->type != DICT)
+	return 0;
+
+    for (args = expr->u.args; args; args = args->next) {
+	switch (args->expr->type) {
+	  case INTEGER:
+	  case STRING:
+	  case DBREF:
+	  case SYMBOL:
+	  case ERROR:
+	    break;
+
+	  default:
+	    if (!constant_aggregate(args->expr))
+		return 0;
+	}
+    }
+    return 1;
+}
+
+/* Effects: Returns the number of case values in cases if they are all
+ *	    integer, string or symbol literals, or 0 if they are not. */
+static int switch_table_cases(Case_list *cases)
+{
+    Expr_list *values;
+    int count = 0;
+
+    for (; cases; cases = cases->next) {
+	for (values = cases->case_entry->values; values; values = values->next) {
+	    switch (values->expr->type) {
+	      case INTEGER:
+	      case STRING:
+	      case SYMBOL:
+		count++;
+		break;
+
+	      default:
+		return 0;
+	    }
+	}
+    }
+    return count;
+}
+
+/* Effects: Returns k if value is var + e1 + ... + ek, with k at least
+ *	    ADD_TAIL_MIN and each of e1..ek a literal or a variable, so that
+ *	    evaluating them twice does no harm; otherwise returns 0. */
+static int add_tail_operands(char *var, Expr *value)
+{
+    int count = 0;
+
+    for (; value->type == BINARY && value->u.binary.opcode == '+';
+	 value = value->u.binary.left) {
+	switch (value->u.binary.right->type) {
+	  case INTEGER:
+	  case STRING:
+	  case DBREF:
+	  case SYMBOL:
+	  case ERROR:
+	  case NAME:
+	  case VAR:
+	    count++;
+	    break;
+
+	  default:
+	    return 0;
+	}
+    }
+
+    if (value->type != VAR || strcmp(value->u.name, var) != 0)
+	return 0;
+    return (count >= ADD_TAIL_MIN) ? count : 0;
+}
+
 /* Requires: Same as compile_stmt() below.
  * Modifies: Uses the instruction buffer and may call compiler_error().
  * Effects: Compiles the statements in stmt_list, in reverse order. */
@@ -807,9 +1071,18 @@ static void compile_stmt(Stmt *stmt, int loop, int catch_level)
 
 	  /* Set switch_dest to here, and code a SWITCH opcode with a jump
 	   * argument pointing to the end of the switch statement.  The
-	   * interpreter won't actually do anything with this instruction. */
-	  code(SWITCH);
-	  code(end_dest);
+	   * interpreter won't actually do anything with this instruction.
+	   * If the cases suit, code a SWITCH_TABLE instead, which jumps
+	   * straight to the right case using a table it builds from the case
+	   * code the first time it runs. */
+	  if (switch_table_cases(stmt->u.switch_.cases) >= SWITCH_TABLE_MIN) {
+	      code(SWITCH_TABLE);
+	      code(end_dest);
+	      code(num_aggregates++);
+	  } else {
+	      code(SWITCH);
+	      code(end_dest);
+	  }
 
 	  /* Pull out the default entry if there is one. */
 	  cases = stmt->u.switch_.cases;
@@ -1065,10 +1338,25 @@ static void compile_expr(Expr *expr)
 
       case ASSIGN: {
 	  Expr *value = expr->u.assign.value;
-	  int n;
-
-	  /* Compile the expression we're assigning or adding. */
-	  compile_expr(value);
+	  int n, count, end_dest;
+
+	  /* Compile the expression we're assigning or adding.  If it adds
+	   * onto the variable itself, push all the operands and code an
+	   * ADD_TAIL, which appends them and jumps to end_dest when they are
+	   * all strings or all lists, and otherwise falls through to code
+	   * which adds them in the usual order. */
+	  count = add_tail_operands(expr->u.assign.var, value);
+	  if (count) {
+	      end_dest = new_jump_dest();
+	      compile_add_tail(value, count, 0);
+	      code(ADD_TAIL);
+	      code(end_dest);
+	      code(count);
+	      compile_add_tail(value, count, 1);
+	      set_jump_dest_here(end_dest);
+	  } else {
+	      compile_expr(value);
+	  }
 
 	  n = find_local_var(expr->u.assign.var);
 	  if (n != -1) {
@@ -1133,6 +1421,11 @@ static void compile_expr(Expr *expr)
       case LIST: {
 	  Expr_list **elistp = &expr->u.args, *elist;
 
+	  if (!in_aggregate && constant_aggregate(expr)) {
+	      compile_aggregate(expr);
+	      break;
+	  }
+
 	  /* [@foo, ...] --> foo [...] SPLICE_ADD */
 	  while (*elistp && (*elistp)->next)
 	      elistp = &(*elistp)->next;
@@ -1163,6 +1456,10 @@ static void compile_expr(Expr *expr)
 
       case DICT:
 
+	if (!in_aggregate && constant_aggregate(expr)) {
+	    compile_aggregate(expr);
+	    break;
+	}
 	code(START_ARGS);
 	compile_expr_list(expr->u.args);
 	code(DICT);
@@ -1325,6 +1622,47 @@ static void compile_expr(Expr *expr)
     }
 }
 
+/* Requires: expr is a constant aggregate (see constant_aggregate()).
+ * Modifies: Uses the instruction buffer.
+ * Effects: Codes expr so that it is built only the first time it runs.  The
+ *	    AGGREGATE opcode pushes the method's copy of the value and jumps
+ *	    past the code which builds it, once AGGREGATE_END has saved one. */
+static void compile_aggregate(Expr *expr)
+{
+    int end_dest = new_jump_dest(), n = num_aggregates++;
+
+    code(AGGREGATE);
+    code(end_dest);
+    code(n);
+
+    in_aggregate = 1;
+    code(START_ARGS);
+    compile_expr_list(expr->u.args);
+    code(expr->type);
+    in_aggregate = 0;
+
+    code(AGGREGATE_END);
+    code(n);
+    set_jump_dest_here(end_dest);
+}
+
+/* Requires: expr is a chain of count additions (see add_tail_operands()).
+ * Modifies: Uses the instruction buffer.
+ * Effects: If add is 0, codes all the operands of the chain, for ADD_TAIL.
+ *	    If add is 1, codes the operands after the first, each followed by
+ *	    an addition, for when ADD_TAIL falls through. */
+static void compile_add_tail(Expr *expr, int count, int add)
+{
+    if (count) {
+	compile_add_tail(expr->u.binary.left, count - 1, add);
+	compile_expr(expr->u.binary.right);
+	if (add)
+	    code('+');
+    } else if (!add) {
+	compile_expr(expr);
+    }
+}
+
 /* Effects: Returns the number of id as a local variable, or -1 if it doesn't
  *	    match any of the local variable names. */
 static int find_local_var(char *id)
@@ -1498,8 +1836,8 @@ static Method *final_pass(Object *object)
 		    break;
 
 		  case STRING:
-		    string = string_from_chars(instr_buf[i].str,
-					       strlen(instr_buf[i].str));
+		    string = string_intern(instr_buf[i].str,
+					   strlen(instr_buf[i].str));
 		    method->opcodes[i] = object_add_string(object, string);
 		    string_discard(string);
 		    break;
@@ -1547,6 +1885,9 @@ static Method *final_pass(Object *object)
 	i++;
     }
 
+    method->num_aggregates = 0;
+    method->aggregates = NULL;
+    method->loop_costs = NULL;
     method->refs = 1;
     return method;
 }
@@ -30,6 +30,33 @@
 /* Maximum number of characters of a data value to display using format(). */
 #define MAX_DATA_DISPLAY 15
 
+/* Most new connections accepted on one port per pass through the main loop;
+ * the rest wait in the listen backlog for the next pass. */
+#define MAX_ACCEPTS	64
+
+/* Threads resolving names for hostname() and ip(), and the number of seconds
+ * to remember their answers. */
+#define DNS_THREADS	4
+#define DNS_CACHE_TTL	300
+
+/* Default marks for a connection's queued output, in bytes.  Passing the high
+ * mark sends the connection's object an "overflow" message; another is sent
+ * only after the queue has drained below the low mark. */
+#define OUTPUT_HIGH_WATER	262144
+#define OUTPUT_LOW_WATER	65536
+
+/* Most bytes read from a connection for one .parse() message.  The input
+ * buffer starts small and doubles up to this size when reads fill it. */
+#define READ_BUDGET		65536
+
+/* Seconds to spend writing out queued output when shutting down. */
+#define FLUSH_TIMEOUT		10
+
+/* Wait for network events with epoll() rather than select(). */
+#ifdef __linux__
+#define USE_EPOLL
+#endif
+
 #define SYSTEM_DBREF	0
 #define ROOT_DBREF	1
 
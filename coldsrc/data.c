@@ -44,9 +44,7 @@ int data_refs(Data *d)
     return 1;
     
   case DICT:
-    assert(d->u.dict->refs > 0);
-    assert(list_check(d->u.dict->keys));
-    assert(list_check(d->u.dict->values));
+    assert(dict_check(d->u.dict));
     return 1;
 
   default:
@@ -73,6 +71,8 @@ int data_cmp(Data *d1, Data *d2)
       case STRING:
 	assert(d1->u.str->refs > 0);
 	assert(d2->u.str->refs > 0);
+	if (d1->u.str == d2->u.str)
+	    return 0;
 	return strccmp(string_chars(d1->u.str), string_chars(d2->u.str));
 
       case DBREF:
@@ -127,6 +127,8 @@ int data_order(Data *d1, Data *d2)
   case STRING:
     assert(d1->u.str->refs > 0);
     assert(d2->u.str->refs > 0);
+    if (d1->u.str == d2->u.str)
+      return 0;
     return strccmp(string_chars(d1->u.str), string_chars(d2->u.str));
     
   case DBREF:
@@ -205,7 +207,7 @@ int data_true(Data *d)
 
       case DICT:
 	assert(data_refs(d));
-	return (d->u.dict->keys->len != 0);
+	return (dict_size(d->u.dict) != 0);
 
       case BUFFER:
 	return (d->u.buffer->len != 0);
@@ -217,7 +219,8 @@ int data_true(Data *d)
 
 unsigned long data_hash(Data *d)
 {
-    List *values;
+    unsigned long hval;
+    int i;
 
     switch (d->type) {
 
@@ -233,33 +236,31 @@ unsigned long data_hash(Data *d)
 
       case LIST:
 	assert(data_refs(d));
-	if (list_length(d->u.list) > 0)
-	    return data_hash(list_first(d->u.list));
-	else
-	    return 100;
+	return list_hash(d->u.list);
 
       case SYMBOL:
-	return hash(ident_name(d->u.symbol));
+	return ident_hash(d->u.symbol);
 
       case ERROR:
-	return hash(ident_name(d->u.error));
+	return ident_hash(d->u.error);
 
       case FROB:
 	return d->u.frob->cclass + data_hash(&d->u.frob->rep);
 
       case DICT:
 	assert(data_refs(d));
-	values = d->u.dict->values;
-	if (list_length(values) > 0)
-	    return data_hash(list_first(values));
-	else
-	    return 200;
+	return dict_hash(d->u.dict);
 
       case BUFFER:
-	if (d->u.buffer->len)
-	    return d->u.buffer->s[0] + d->u.buffer->s[d->u.buffer->len - 1];
-	else
+	/* Buffers change in place, so there's nothing to cache this in. */
+	if (d->u.buffer->len) {
+	    hval = 0;
+	    for (i = 0; i < d->u.buffer->len; i++)
+		hval = hval * 31 + d->u.buffer->s[i];
+	    return hval;
+	} else {
 	    return 300;
+	}
 
       default:
 	panic("data_hash() called with invalid type");
@@ -53,6 +53,7 @@ int data_refs(Data *d);
 
 #define DATA_H_DONE
 #include "list.h"
+#include "dict.h"
 #include "object.h"
 
 #endif
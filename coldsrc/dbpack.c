@@ -157,49 +157,61 @@ static int size_list(List *list)
     return size;
 }
 
+/* Dictionaries are stored as a list of keys and a list of values, followed
+ * by a hash table which is no longer used.  We write an empty one. */
 void pack_dict(Dict *dict, FILE *fp)
 {
-    int i;
+    Dict_entry *e, *end;
 
-    pack_list(dict->keys, fp);
-    pack_list(dict->values, fp);
-    write_long(dict->hashtab_size, fp);
-    for (i = 0; i < dict->hashtab_size; i++) {
-	write_long(dict->links[i], fp);
-	write_long(dict->hashtab[i], fp);
+    end = dict->entries + dict->num_entries;
+    write_long(dict_size(dict), fp);
+    for (e = dict->entries; e < end; e++) {
+	if (e->key.type != NOT_AN_IDENT)
+	    pack_data(&e->key, fp);
+    }
+    write_long(dict_size(dict), fp);
+    for (e = dict->entries; e < end; e++) {
+	if (e->key.type != NOT_AN_IDENT)
+	    pack_data(&e->value, fp);
     }
+    write_long(0, fp);
 }
 
 Dict *unpack_dict(FILE *fp)
 {
     Dict *dict;
-    int i;
+    List *keys, *values;
+    int i, size;
+
+    keys = unpack_list(fp);
+    values = unpack_list(fp);
 
-    dict = EMALLOC(Dict, 1);
-    dict->keys = unpack_list(fp);
-    dict->values = unpack_list(fp);
-    dict->hashtab_size = read_long(fp);
-    dict->links = EMALLOC(int, dict->hashtab_size);
-    dict->hashtab = EMALLOC(int, dict->hashtab_size);
-    for (i = 0; i < dict->hashtab_size; i++) {
-	dict->links[i] = read_long(fp);
-	dict->hashtab[i] = read_long(fp);
+    /* Skip the stored hash table, if any, and build a new one. */
+    size = read_long(fp);
+    for (i = 0; i < size; i++) {
+	read_long(fp);
+	read_long(fp);
     }
-    dict->refs = 1;
+    dict = dict_new(keys, values);
+    list_discard(keys);
+    list_discard(values);
     return dict;
 }
 
 static int size_dict(Dict *dict)
 {
-    int size = 0, i;
+    Dict_entry *e, *end;
+    int size = 0;
 
-    size += size_list(dict->keys);
-    size += size_list(dict->values);
-    size += size_long(dict->hashtab_size);
-    for (i = 0; i < dict->hashtab_size; i++) {
-	size += size_long(dict->links[i]);
-	size += size_long(dict->hashtab[i]);
+    end = dict->entries + dict->num_entries;
+    size += size_long(dict_size(dict)) * 2;
+    for (e = dict->entries; e < end; e++) {
+	if (e->key.type != NOT_AN_IDENT) {
+	    size += size_data(&e->key);
+	    size += size_data(&e->value);
+	}
     }
+    size += size_long(0);
     return size;
 }
 
@@ -345,6 +357,9 @@ static Method *unpack_method(FILE *fp)
 
     method->overridable = read_long(fp);
 
+    method->num_aggregates = 0;
+    method->aggregates = NULL;
+    method->loop_costs = NULL;
     method->refs = 1;
     return method;
 }
@@ -45,6 +45,7 @@ static Expr_list *decompile_case_values(int *pos_ptr, int *end_ret);
 static Id_list *make_error_id_list(int which);
 static Expr_list *decompile_expressions(int *pos_ptr);
 static Expr_list *decompile_expressions_bounded(int *pos_ptr, int end);
+static Expr *add_tail_expr(Expr_list *operands, int count);
 static List *unparse_stmt_list(List *output, Stmt_list *stmts, int indent);
 static List *unparse_stmt(List *output, Stmt *stmt, int indent, Stmt *last);
 static int is_complex_if_else_stmt(Stmt *stmt);
@@ -293,14 +294,15 @@ static int count_lines(int start, int end, unsigned *flags)
 	      break;
 	  }
 
-	  case SWITCH: {
+	  case SWITCH:
+	  case SWITCH_TABLE: {
 	      int body_end;
 	      unsigned body_flags;
 
 	      /* Count switch header and consider body. */
 	      count++;
 	      body_end = the_opcodes[start + 1];
-	      start += 2;
+	      start = next;
 
 	      if (end < body_end) {
 		  /* End is in switch body. */
@@ -533,12 +535,15 @@ static Stmt *decompile_stmt(int *pos_ptr)
 	(*pos_ptr) = end;
 	return while_stmt(exprs->expr, body);
 
-      case SWITCH: {
+      case SWITCH:
+      case SWITCH_TABLE: {
 	  Case_list *cases;
 
-	  /* SWITCH statement follows one opcode. */
+	  /* SWITCH statement follows one opcode.  SWITCH_TABLE has an extra
+	   * argument, the method's slot for its table. */
 	  end = the_opcodes[pos + 1];
-	  cases = decompile_cases(pos + 2, end);
+	  cases = decompile_cases(pos + ((the_opcodes[pos] == SWITCH) ? 2 : 3),
+				  end);
 	  (*pos_ptr) = end;
 	  return switch_stmt(exprs->expr, cases);
       }
@@ -757,6 +762,7 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	  case DBREF:
 	    stack = expr_list(dbref_expr(the_opcodes[pos + 1]), stack);
 	    pos += 2;
+	    break;
 
 	  case SYMBOL:
 	    s = ident_name(object_get_ident(the_object, the_opcodes[pos + 1]));
@@ -928,6 +934,12 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	    pos++;
 	    break;
 
+	  case AGGREGATE:
+	  case AGGREGATE_END:
+	    /* Ignore these; the code between them builds the value. */
+	    pos += (the_opcodes[pos] == AGGREGATE) ? 3 : 2;
+	    break;
+
 	  case '!':
 	  case NEG:
 	    stack->expr = unary_expr(the_opcodes[pos], stack->expr);
@@ -952,6 +964,19 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
 	    pos++;
 	    break;
 
+	  case ADD_TAIL: {
+	      int count = the_opcodes[pos + 2];
+	      Expr *chain = add_tail_expr(stack, count);
+
+	      /* Replace the operands with the chain of additions, and skip
+	       * the code which adds them one at a time. */
+	      while (count--)
+		  stack = stack->next;
+	      stack->expr = chain;
+	      pos = the_opcodes[pos + 1];
+	      break;
+	  }
+
 	  case SPLICE_ADD: {
 	      Expr_list **elistp = &stack->expr->u.args;
 
@@ -987,6 +1012,16 @@ static Expr_list *decompile_expressions_bounded(int *pos_ptr, int expr_end)
     return stack;
 }
 
+/* Build the chain of additions an ADD_TAIL opcode stands for from the last
+ * count + 1 expressions on the stack (the last one is on top). */
+static Expr *add_tail_expr(Expr_list *operands, int count)
+{
+    if (!count)
+	return operands->expr;
+    return binary_expr('+', add_tail_expr(operands->next, count - 1),
+		       operands->expr);
+}
+
 /* Write a statement list onto the output list, backwards. */
 static List *unparse_stmt_list(List *output, Stmt_list *stmts, int indent)
 {
@@ -1507,8 +1542,11 @@ static String *unparse_expr_prec(String *str, Expr *expr, int caller_type,
 {
     int caller_prec = prec_level(caller_type), type, prec;
 
+    /* A negative integer was compiled from a negated literal, and needs the
+     * same parentheses. */
     type = (expr->type == BINARY) ? expr->u.binary.opcode :
-	(expr->type == UNARY) ? expr->u.unary.opcode : expr->type;
+	(expr->type == UNARY) ? expr->u.unary.opcode :
+	(expr->type == INTEGER && expr->u.num < 0) ? NEG : expr->type;
     prec = prec_level(type);
 
     if (prec >= 0 && (the_parens_flag || caller_prec + assoc > prec)) {
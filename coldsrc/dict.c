@@ -3,106 +3,102 @@
 #define _POSIX_SOURCE
 
 #include <stdio.h>
+#include <assert.h>
 #include "x.tab.h"
 #include "dict.h"
 #include "memory.h"
 #include "ident.h"
 
 #define MALLOC_DELTA			 5
-#define HASHTAB_STARTING_SIZE		(32 - MALLOC_DELTA)
+#define ENTRIES_STARTING_SIZE		(16 - MALLOC_DELTA)
+#define TABLE_STARTING_SIZE		16
 
+/* Values of table slots which don't hold an entry index. */
+#define EMPTY				-1
+#define TOMBSTONE			-2
+
+/* Keep at least a third of the table empty, so that probes stay short. */
+#define TABLE_FULL(dict)	((dict)->table_used * 3 >= (dict)->table_size * 2)
+
+#define IS_HOLE(entry)		((entry)->key.type == NOT_AN_IDENT)
+
+static Dict *dict_new_sized(int len);
 static Dict *prepare_to_modify(Dict *dict);
-static void insert_key(Dict *dict, int i);
-static int search(Dict *dict, Data *key);
-static void double_hashtab_size(Dict *dict);
+static int search(Dict *dict, Data *key, unsigned long hval, int *slot);
+static void insert_key(Dict *dict, Data *key, unsigned long hval, Data *value,
+		       int slot);
+static void rebuild_table(Dict *dict, int len);
+static Dict_entry *entries(Dict *dict);
+static int order_entries(Dict *dict1, Dict *dict2, int values);
+
+#ifndef NDEBUG
+int dict_check(Dict *dict)
+{
+    int i;
+
+    assert(dict->refs > 0);
+    assert(dict->count <= dict->num_entries);
+    for (i = 0; i < dict->num_entries; i++) {
+	if (!IS_HOLE(&dict->entries[i])) {
+	    assert(data_refs(&dict->entries[i].key));
+	    assert(data_refs(&dict->entries[i].value));
+	}
+    }
+    return 1;
+}
+#endif
 
 Dict *dict_new(List *keys, List *values)
 {
     Dict *cnew;
-    int i, j;
+    Data *key, *value;
+    unsigned long hval;
+    int slot;
 
     if (list_length(keys) != list_length(values)) {
       return (Dict *)0;
     }
 
-    /* Construct a new dictionary. */
-    cnew = EMALLOC(Dict, 1);
-    cnew->keys = list_dup(keys);
-    cnew->values = list_dup(values);
-
-    /* Calculate initial size of chain and hash table. */
-    cnew->hashtab_size = HASHTAB_STARTING_SIZE;
-    while (cnew->hashtab_size < keys->len)
-	cnew->hashtab_size = cnew->hashtab_size * 2 + MALLOC_DELTA;
-
-    /* Initialize chain entries and hash table. */
-    cnew->links = EMALLOC(int, cnew->hashtab_size);
-    cnew->hashtab = EMALLOC(int, cnew->hashtab_size);
-    for (i = 0; i < cnew->hashtab_size; i++) {
-	cnew->links[i] = -1;
-	cnew->hashtab[i] = -1;
-    }
-
-    /* Insert the keys into the hash table, eliminating duplicates. */
-    i = j = 0;
-    while (i < cnew->keys->len) {
-	if (i != j) {
-	    cnew->keys->el[j] = cnew->keys->el[i];
-	    cnew->values->el[j] = cnew->values->el[i];
-	}
-	if (search(cnew, &keys->el[i]) == -1) {
-	    insert_key(cnew, j++);
-	} else {
-	    data_discard(&cnew->keys->el[i]);
-	    data_discard(&cnew->values->el[i]);
-	}
-	i++;
+    /* Construct a new dictionary, and insert the keys, keeping the first of
+     * any duplicates. */
+    cnew = dict_new_sized(list_length(keys));
+    value = list_first(values);
+    for (key = list_first(keys); key; key = list_next(keys, key)) {
+	hval = data_hash(key);
+	if (search(cnew, key, hval, &slot) == -1)
+	    insert_key(cnew, key, hval, value, slot);
+	value = list_next(values, value);
     }
-    cnew->keys->len = cnew->values->len = j;
-
-    cnew->refs = 1;
 
     return cnew;
 }
 
 Dict *dict_new_empty(void)
 {
-    List *l1, *l2;
-    Dict *dict;
-
-    l1 = list_new(0);
-    l2 = list_new(0);
-    dict = dict_new(l1, l2);
-    list_discard(l1);
-    list_discard(l2);
-    return dict;
+    return dict_new_sized(0);
 }
 
 Dict *dict_from_slices(List *slices)
 {
-    List *keys, *values;
     Dict *dict;
-    Data *d;
-
-    /* Make lists for keys and values. */
-    keys = list_new(list_length(slices));
-    values = list_new(list_length(slices));
+    Data *d, *key;
+    unsigned long hval;
+    int slot;
 
+    dict = dict_new_sized(list_length(slices));
     for (d = list_first(slices); d; d = list_next(slices, d)) {
 	if (d->type != LIST || list_length(d->u.list) != 2) {
 	    /* Invalid slice.  Throw away what we had and return NULL. */
-	    list_discard(keys);
-	    list_discard(values);
+	    dict_discard(dict);
 	    return NULL;
 	}
-	keys = list_add(keys, list_elem(d->u.list, 0));
-	values = list_add(values, list_elem(d->u.list, 1));
+	key = list_elem(d->u.list, 0);
+	hval = data_hash(key);
+	if (search(dict, key, hval, &slot) == -1)
+	    insert_key(dict, key, hval, list_elem(d->u.list, 1), slot);
     }
 
     /* Slices were all valid; return new dict. */
-    dict = dict_new(keys, values);
-    list_discard(keys);
-    list_discard(values);
     return dict;
 }
 
@@ -114,52 +110,83 @@ Dict *dict_dup(Dict *dict)
 
 void dict_discard(Dict *dict)
 {
+    int i;
+
     dict->refs--;
     if (!dict->refs) {
-	list_discard(dict->keys);
-	list_discard(dict->values);
-	free(dict->links);
-	free(dict->hashtab);
+	for (i = 0; i < dict->num_entries; i++) {
+	    if (!IS_HOLE(&dict->entries[i])) {
+		data_discard(&dict->entries[i].key);
+		data_discard(&dict->entries[i].value);
+	    }
+	}
+	free(dict->entries);
+	free(dict->table);
 	free(dict);
     }
 }
 
 int dict_cmp(Dict *dict1, Dict *dict2)
 {
-    if (list_cmp(dict1->keys, dict2->keys) == 0 &&
-	list_cmp(dict1->values, dict2->values) == 0)
+    Dict_entry *e1, *e2;
+    int i;
+
+    if (dict1 == dict2)
 	return 0;
-    else
+    if (dict1->count != dict2->count)
 	return 1;
+
+    e1 = entries(dict1);
+    e2 = entries(dict2);
+    for (i = 0; i < dict1->count; i++) {
+	if (data_cmp(&e1[i].key, &e2[i].key) != 0 ||
+	    data_cmp(&e1[i].value, &e2[i].value) != 0)
+	    return 1;
+    }
+    return 0;
 }
 
 int dict_order(Dict *dict1, Dict *dict2)
 {
-  return list_order(dict1->keys, dict2->keys) || list_order(dict1->values, dict2->values);
+  return order_entries(dict1, dict2, 0) || order_entries(dict1, dict2, 1);
+}
+
+/* Effects: Returns a hash of dict, such that dictionaries which dict_cmp()
+ *	    finds equivalent hash alike. */
+unsigned long dict_hash(Dict *dict)
+{
+    Dict_entry *e;
+    unsigned long keys = 0, values = 0;
+    int i;
+
+    if (!dict->count)
+	return 200;
+
+    e = entries(dict);
+    for (i = 0; i < dict->count; i++) {
+	keys = keys * 31 + e[i].hval;
+	values = values * 31 + data_hash(&e[i].value);
+    }
+    return keys * 31 + values;
 }
 
 Dict *dict_add(Dict *dict, Data *key, Data *value)
 {
-    int pos;
+    unsigned long hval;
+    int pos, slot;
 
     dict = prepare_to_modify(dict);
 
     /* Just replace the value for the key if it already exists. */
-    pos = search(dict, key);
+    hval = data_hash(key);
+    pos = search(dict, key, hval, &slot);
     if (pos != -1) {
-	dict->values = list_replace(dict->values, pos, value);
+	data_discard(&dict->entries[pos].value);
+	data_dup(&dict->entries[pos].value, value);
 	return dict;
     }
 
-    /* Add the key and value to the list. */
-    dict->keys = list_add(dict->keys, key);
-    dict->values = list_add(dict->values, value);
-
-    /* Check if we should resize the hash table. */
-    if (dict->keys->len > dict->hashtab_size)
-	double_hashtab_size(dict);
-    else
-	insert_key(dict, dict->keys->len - 1);
+    insert_key(dict, key, hval, value, slot);
     return dict;
 }
 
@@ -167,163 +194,288 @@ Dict *dict_add(Dict *dict, Data *key, Data *value)
  * will find the key in the dictionary. */
 Dict *dict_del(Dict *dict, Data *key)
 {
-    int ind, *ip, i = -1, j;
+    Dict_entry *entry;
+    int pos, slot;
 
     dict = prepare_to_modify(dict);
 
-    /* Search for a pointer to the key, either in the hash table entry or in
-     * the chain links. */
-    ind = data_hash(key) % dict->hashtab_size;
-    for (ip = &dict->hashtab[ind];; ip = &dict->links[*ip]) {
-	i = *ip;
-	if (data_cmp(&dict->keys->el[i], key) == 0)
-	    break;
-    }
+    /* Leave a tombstone in the table, so that probes for keys placed after
+     * this one still find them, and a hole in the entries. */
+    pos = search(dict, key, data_hash(key), &slot);
+    assert(pos != -1);
+    dict->table[slot] = TOMBSTONE;
 
-    /* Delete the element from the keys and values lists. */
-    dict->keys = list_delete(dict->keys, i);
-    dict->values = list_delete(dict->values, i);
-
-    /* Replace the pointer to the key index with the next link. */
-    *ip = dict->links[i];
-
-    /* Copy the links beyond i backward. */
-    MEMMOVE(dict->links + i, dict->links + i + 1, dict->keys->len - i);
-    dict->links[dict->keys->len] = -1;
-
-    /* Since we've renumbered all the elements beyond i, we have to check
-     * all the links and hash table entries.  If they're greater than i,
-     * decrement them.  Skip this step if the element we removed was the last
-     * one. */
-    if (i < dict->keys->len) {
-	for (j = 0; j < dict->keys->len; j++) {
-	    if (dict->links[j] > i)
-		dict->links[j]--;
-	}
-	for (j = 0; j < dict->hashtab_size; j++) {
-	    if (dict->hashtab[j] > i)
-		dict->hashtab[j]--;
-	}
-    }
+    entry = &dict->entries[pos];
+    data_discard(&entry->key);
+    data_discard(&entry->value);
+    entry->key.type = NOT_AN_IDENT;
+    dict->count--;
+
+    /* If the entry was the last one, we can forget it altogether. */
+    if (pos == dict->num_entries - 1)
+	dict->num_entries--;
 
     return dict;
 }
 
 long dict_find(Dict *dict, Data *key, Data *ret)
 {
-    int pos;
+    int pos, slot;
 
-    pos = search(dict, key);
+    pos = search(dict, key, data_hash(key), &slot);
     if (pos == -1)
 	return keynf_id;
 
-    data_dup(ret, &dict->values->el[pos]);
+    data_dup(ret, &dict->entries[pos].value);
     return NOT_AN_IDENT;
 }
 
 int dict_contains(Dict *dict, Data *key)
 {
-    int pos;
+    int pos, slot;
 
-    pos = search(dict, key);
+    pos = search(dict, key, data_hash(key), &slot);
     return (pos != -1);
 }
 
 List *dict_keys(Dict *dict)
 {
-    return list_dup(dict->keys);
+    Dict_entry *e;
+    List *keys;
+    Data *d;
+    int i;
+
+    e = entries(dict);
+    keys = list_new(dict->count);
+    d = list_empty_spaces(keys, dict->count);
+    for (i = 0; i < dict->count; i++)
+	data_dup(&d[i], &e[i].key);
+    return keys;
+}
+
+List *dict_values(Dict *dict)
+{
+    Dict_entry *e;
+    List *values;
+    Data *d;
+    int i;
+
+    e = entries(dict);
+    values = list_new(dict->count);
+    d = list_empty_spaces(values, dict->count);
+    for (i = 0; i < dict->count; i++)
+	data_dup(&d[i], &e[i].value);
+    return values;
 }
 
 List *dict_key_value_pair(Dict *dict, int i)
 {
+    Dict_entry *e;
     List *l;
 
-    if (i >= dict->keys->len)
+    if (i >= dict->count)
 	return NULL;
+    e = entries(dict);
     l = list_new(2);
     l->len = 2;
-    data_dup(&l->el[0], &dict->keys->el[i]);
-    data_dup(&l->el[1], &dict->values->el[i]);
+    data_dup(&l->el[0], &e[i].key);
+    data_dup(&l->el[1], &e[i].value);
     return l;
 }
 
 String *dict_add_literal_to_str(String *str, Dict *dict)
 {
+    Dict_entry *e;
     int i;
 
+    e = entries(dict);
     str = string_add_chars(str, "#[", 2);
-    for (i = 0; i < dict->keys->len; i++) {
+    for (i = 0; i < dict->count; i++) {
 	str = string_addc(str, '[');
-	str = data_add_literal_to_str(str, &dict->keys->el[i]);
+	str = data_add_literal_to_str(str, &e[i].key);
 	str = string_add_chars(str, ", ", 2);
-	str = data_add_literal_to_str(str, &dict->values->el[i]);
+	str = data_add_literal_to_str(str, &e[i].value);
 	str = string_addc(str, ']');
-	if (i < dict->keys->len - 1)
+	if (i < dict->count - 1)
 	    str = string_add_chars(str, ", ", 2);
-    }	
+    }
     return string_addc(str, ']');
 }
 
+int dict_size(Dict *dict)
+{
+    return dict->count;
+}
+
+/* Effects: Returns a new, empty dictionary with room for len entries. */
+static Dict *dict_new_sized(int len)
+{
+    Dict *cnew;
+
+    cnew = EMALLOC(Dict, 1);
+    cnew->entries_size = ENTRIES_STARTING_SIZE;
+    while (cnew->entries_size < len)
+	cnew->entries_size = cnew->entries_size * 2 + MALLOC_DELTA;
+    cnew->entries = EMALLOC(Dict_entry, cnew->entries_size);
+    cnew->num_entries = 0;
+    cnew->count = 0;
+    cnew->table = NULL;
+    rebuild_table(cnew, len);
+    cnew->refs = 1;
+    return cnew;
+}
+
 static Dict *prepare_to_modify(Dict *dict)
 {
     Dict *cnew;
+    int i;
 
     if (dict->refs == 1)
 	return dict;
 
-    /* Duplicate the old dictionary. */
-    cnew = EMALLOC(Dict, 1);
-    cnew->keys = list_dup(dict->keys);
-    cnew->values = list_dup(dict->values);
-    cnew->hashtab_size = dict->hashtab_size;
-    cnew->links = EMALLOC(int, cnew->hashtab_size);
-    MEMCPY(cnew->links, dict->links, cnew->hashtab_size);
-    cnew->hashtab = EMALLOC(int, cnew->hashtab_size);
-    MEMCPY(cnew->hashtab, dict->hashtab, cnew->hashtab_size);
+    /* Duplicate the old dictionary, leaving out any holes. */
+    cnew = dict_new_sized(dict->count);
+    for (i = 0; i < dict->num_entries; i++) {
+	if (!IS_HOLE(&dict->entries[i])) {
+	    cnew->entries[cnew->num_entries] = dict->entries[i];
+	    data_dup(&cnew->entries[cnew->num_entries].key,
+		     &dict->entries[i].key);
+	    data_dup(&cnew->entries[cnew->num_entries].value,
+		     &dict->entries[i].value);
+	    cnew->num_entries++;
+	}
+    }
+    cnew->count = cnew->num_entries;
+    rebuild_table(cnew, cnew->count);
     dict->refs--;
-    cnew->refs = 1;
     return cnew;
 }
 
-static void insert_key(Dict *dict, int i)
+/* Effects: Looks for key, whose hash is hval, in dict.  Returns the index of
+ *	    its entry, or -1 if it isn't there.  Sets *slot to the table slot
+ *	    holding the key if it was found, or else to the slot where it
+ *	    should be inserted. */
+static int search(Dict *dict, Data *key, unsigned long hval, int *slot)
 {
-    int ind;
+    unsigned long mask = dict->table_size - 1, perturb = hval, i;
+    int ind, free_slot = -1;
+
+    for (i = hval & mask;; i = (i * 5 + 1 + perturb) & mask, perturb >>= 5) {
+	ind = dict->table[i];
+	if (ind == EMPTY) {
+	    *slot = (free_slot == -1) ? i : free_slot;
+	    return -1;
+	}
+	if (ind == TOMBSTONE) {
+	    if (free_slot == -1)
+		free_slot = i;
+	} else if (dict->entries[ind].hval == hval &&
+		   data_cmp(&dict->entries[ind].key, key) == 0) {
+	    *slot = i;
+	    return ind;
+	}
+    }
+}
+
+/* Requires: key is not in dict, and slot is where search() said to put it.
+ * Effects: Adds an entry for key and value to the end of dict's entries. */
+static void insert_key(Dict *dict, Data *key, unsigned long hval, Data *value,
+		       int slot)
+{
+    Dict_entry *entry;
+
+    if (dict->num_entries == dict->entries_size &&
+	dict->count < dict->num_entries / 2) {
+	/* Mostly holes left by deletions; squeeze them out rather than grow,
+	 * and find the key's new slot. */
+	rebuild_table(dict, dict->count * 2);
+	search(dict, key, hval, &slot);
+    } else if (dict->num_entries == dict->entries_size) {
+	dict->entries_size = dict->entries_size * 2 + MALLOC_DELTA;
+	dict->entries = EREALLOC(dict->entries, Dict_entry,
+				 dict->entries_size);
+    }
 
-    ind = data_hash(&dict->keys->el[i]) % dict->hashtab_size;
-    dict->links[i] = dict->hashtab[ind];
-    dict->hashtab[ind] = i;
+    entry = &dict->entries[dict->num_entries];
+    entry->hval = hval;
+    data_dup(&entry->key, key);
+    data_dup(&entry->value, value);
+
+    if (dict->table[slot] == EMPTY)
+	dict->table_used++;
+    dict->table[slot] = dict->num_entries++;
+    dict->count++;
+
+    if (TABLE_FULL(dict))
+	rebuild_table(dict, dict->count * 2);
 }
 
-static int search(Dict *dict, Data *key)
+/* Modifies: dict.
+ * Effects: Squeezes the holes out of dict's entries, and rebuilds its table
+ *	    with room for at least len entries. */
+static void rebuild_table(Dict *dict, int len)
 {
-    int ind, i;
+    Dict_entry *e = dict->entries;
+    unsigned long mask, perturb, i;
+    int j, k;
 
-    ind = data_hash(key) % dict->hashtab_size;
-    for (i = dict->hashtab[ind]; i != -1; i = dict->links[i]) {
-	if (data_cmp(&dict->keys->el[i], key) == 0)
-	    return i;
+    for (j = k = 0; j < dict->num_entries; j++) {
+	if (!IS_HOLE(&e[j]))
+	    e[k++] = e[j];
     }
-
-    return -1;
+    dict->num_entries = k;
+
+    dict->table_size = TABLE_STARTING_SIZE;
+    while (dict->table_size * 2 <= len * 3)
+	dict->table_size *= 2;
+    if (dict->table)
+	free(dict->table);
+    dict->table = EMALLOC(int, dict->table_size);
+    for (j = 0; j < dict->table_size; j++)
+	dict->table[j] = EMPTY;
+
+    mask = dict->table_size - 1;
+    for (j = 0; j < dict->num_entries; j++) {
+	perturb = e[j].hval;
+	for (i = perturb & mask; dict->table[i] != EMPTY;
+	     i = (i * 5 + 1 + perturb) & mask, perturb >>= 5);
+	dict->table[i] = j;
+    }
+    dict->table_used = dict->num_entries;
 }
 
-int dict_size(Dict *dict)
+/* Effects: Returns dict's entries with any holes squeezed out, so that the
+ *	    first dict->count of them are the live entries in order.  This
+ *	    doesn't change the dictionary's contents, so it's all right even
+ *	    if the dictionary is shared. */
+static Dict_entry *entries(Dict *dict)
 {
-    return list_length(dict->keys);
+    if (dict->num_entries != dict->count)
+	rebuild_table(dict, dict->count);
+    return dict->entries;
 }
 
-static void double_hashtab_size(Dict *dict)
+/* Effects: Orders dict1 and dict2 by their keys, or by their values if
+ *	    values is set, in the way list_order() orders lists. */
+static int order_entries(Dict *dict1, Dict *dict2, int values)
 {
-    int i;
+    Dict_entry *e1, *e2;
+    int i, len, diff;
+
+    if (dict1 == dict2)
+	return 0;
 
-    dict->hashtab_size = dict->hashtab_size * 2 + MALLOC_DELTA;
-    dict->links = EREALLOC(dict->links, int, dict->hashtab_size);
-    dict->hashtab = EREALLOC(dict->hashtab, int, dict->hashtab_size);
-    for (i = 0; i < dict->hashtab_size; i++) {
-	dict->links[i] = -1;
-	dict->hashtab[i] = -1;
+    e1 = entries(dict1);
+    e2 = entries(dict2);
+    len = (dict1->count < dict2->count) ? dict1->count : dict2->count;
+    for (i = 0; i < len; i++) {
+	if (values)
+	    diff = data_order(&e1[i].value, &e2[i].value);
+	else
+	    diff = data_order(&e1[i].key, &e2[i].key);
+	if (diff != 0)
+	    return diff;
     }
-    for (i = 0; i < dict->keys->len; i++)
-	insert_key(dict, i);
-}
 
+    return dict1->count - dict2->count;
+}
@@ -1,18 +1,40 @@
 /* dict.h: Declarations for C-- dictionaries. */
 
-#ifndef DICT_H
-#define DICT_H
+/* As with list.h, we need to run this file after data.h has completed,
+ * since dictionary entries contain Data. */
 
+#ifndef DID_DICT_TYPEDEF
 typedef struct dict Dict;
+typedef struct dict_entry Dict_entry;
+#define DID_DICT_TYPEDEF
+#endif
 
 #include "data.h"
 
+#ifdef DATA_H_DONE
+
+#ifndef DICT_H
+#define DICT_H
+
+/* A dictionary keeps its entries in an array in the order they were added,
+ * and finds them through an open-addressed table of indices into that array.
+ * Deleting an entry leaves a hole (an entry whose key has type NOT_AN_IDENT)
+ * in the array and a tombstone in the table; holes are squeezed out when the
+ * table is rebuilt, or when something needs the entries by position. */
+struct dict_entry {
+    unsigned long hval;		/* data_hash(&key) */
+    Data key;
+    Data value;
+};
+
 struct dict {
-    List *keys;
-    List *values;
-    int *links;
-    int *hashtab;
-    int hashtab_size;
+    Dict_entry *entries;
+    int num_entries;		/* Entries in use, including holes. */
+    int entries_size;
+    int count;			/* Entries in use, not including holes. */
+    int *table;
+    int table_size;		/* Always a power of two. */
+    int table_used;		/* Table slots not empty, including tombstones. */
     int refs;
 };
 
@@ -23,14 +45,19 @@ Dict *dict_dup(Dict *dict);
 void dict_discard(Dict *dict);
 int dict_cmp(Dict *dict1, Dict *dict2);
 int dict_order(Dict *dict1, Dict *dict2);
+unsigned long dict_hash(Dict *dict);
 Dict *dict_add(Dict *dict, Data *key, Data *value);
 Dict *dict_del(Dict *dict, Data *key);
 long dict_find(Dict *dict, Data *key, Data *ret);
 int dict_contains(Dict *dict, Data *key);
 List *dict_keys(Dict *dict);
+List *dict_values(Dict *dict);
 List *dict_key_value_pair(Dict *mapping, int i);
 int dict_size(Dict *dict);
 String *dict_add_literal_to_str(String *str, Dict *dict);
+int dict_check(Dict *dict);
+
+#endif
 
 #endif
 
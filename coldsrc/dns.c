@@ -0,0 +1,256 @@
+/* dns.c: Asynchronous name resolution. */
+/* The resolver can take seconds to answer, and the server is single-threaded,
+ * so hostname() and ip() hand their lookups to a small pool of threads and
+ * suspend the calling task.  The threads signal finished lookups on a pipe
+ * which io_event_wait() watches, and dns_deliver() resumes each task with its
+ * answer.  Answers are remembered for DNS_CACHE_TTL seconds.
+ *
+ * The threads touch nothing but the Query they are working on and the two
+ * queues below; all String handling stays in the main thread. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+#include "x.tab.h"
+#include "dns.h"
+#include "execute.h"
+#include "memory.h"
+#include "config.h"
+#include "log.h"
+#include "util.h"
+
+#define ANSWER_SIZE	256
+#define CACHE_SIZE	256
+
+typedef struct query Query;
+typedef struct entry Entry;
+
+struct query {
+    long task_id;		/* Task waiting for the answer. */
+    int reverse;		/* Looking up a name rather than an address. */
+    char *name;
+    char answer[ANSWER_SIZE];
+    Query *next;
+};
+
+struct entry {
+    int reverse;
+    char *name;
+    String *answer;
+    time_t expires;
+    Entry *next;
+};
+
+static void start_resolver(void);
+static void *resolver(void *arg);
+static void resolve(Query *q);
+static void cache_answer(Query *q, String *answer);
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wanted = PTHREAD_COND_INITIALIZER;
+static Query *todo, **todo_tail = &todo;	/* Waiting for a thread. */
+static Query *done;				/* Waiting for delivery. */
+static int wakeup[2] = { -1, -1 };
+
+static Entry *cache[CACHE_SIZE];
+
+/* Answer a lookup of name, which is an address to find the name of if reverse
+ * is true, or a name to find the address of otherwise.  Returns the answer if
+ * it is known now.  Otherwise, queues the lookup for the current task and
+ * returns NULL; the caller should suspend the task with task_wait_dns(), and
+ * it will be resumed with the answer. */
+String *dns_lookup(char *name, int reverse)
+{
+    Entry **entryp, *entry;
+    Query *q;
+    time_t now;
+    int is_addr;
+
+    /* Names are the only things with addresses, and addresses the only things
+     * with names; anything else is its own answer. */
+    is_addr = (inet_addr(name) != INADDR_NONE);
+    if (reverse ? !is_addr : is_addr)
+	return string_from_chars(name, strlen(name));
+
+    time(&now);
+    entryp = &cache[hash(name) % CACHE_SIZE];
+    while (*entryp) {
+	entry = *entryp;
+	if (entry->expires <= now) {
+	    *entryp = entry->next;
+	    tfree_chars(entry->name);
+	    string_discard(entry->answer);
+	    free(entry);
+	} else if (entry->reverse == reverse && !strcmp(entry->name, name)) {
+	    return string_dup(entry->answer);
+	} else {
+	    entryp = &entry->next;
+	}
+    }
+
+    if (wakeup[0] == -1)
+	start_resolver();
+
+    q = EMALLOC(Query, 1);
+    q->task_id = task_id;
+    q->reverse = reverse;
+    q->name = tstrdup(name);
+    q->next = NULL;
+
+    pthread_mutex_lock(&lock);
+    *todo_tail = q;
+    todo_tail = &q->next;
+    pthread_cond_signal(&wanted);
+    pthread_mutex_unlock(&lock);
+
+    return NULL;
+}
+
+/* The descriptor to watch for finished lookups, or -1 if there have been
+ * none yet. */
+int dns_fd(void)
+{
+    return wakeup[0];
+}
+
+/* Resume the tasks whose lookups have finished. */
+void dns_deliver(void)
+{
+    char buf[64];
+    Query *q, *next;
+    VMState *vm;
+    Data d;
+
+    if (wakeup[0] == -1)
+	return;
+    while (read(wakeup[0], buf, sizeof(buf)) > 0);
+
+    pthread_mutex_lock(&lock);
+    q = done;
+    done = NULL;
+    pthread_mutex_unlock(&lock);
+
+    for (; q; q = next) {
+	next = q->next;
+	d.type = STRING;
+	d.u.str = string_from_chars(q->answer, strlen(q->answer));
+	cache_answer(q, d.u.str);
+
+	/* The task may have been cancelled while it waited.  resume() refuses
+	 * tasks waiting here, so one still waiting is waiting for this. */
+	vm = task_lookup(q->task_id);
+	if (vm && vm->dns_wait && !vm->paused)
+	    task_resume(q->task_id, &d);
+
+	string_discard(d.u.str);
+	tfree_chars(q->name);
+	free(q);
+    }
+}
+
+static void start_resolver(void)
+{
+    pthread_t thread;
+    sigset_t all, old;
+    int i, flags;
+
+    if (pipe(wakeup) == -1)
+	panic("Couldn't create resolver pipe.");
+    for (i = 0; i < 2; i++) {
+	flags = fcntl(wakeup[i], F_GETFL);
+	fcntl(wakeup[i], F_SETFL, flags | O_NONBLOCK);
+	flags = fcntl(wakeup[i], F_GETFD);
+	fcntl(wakeup[i], F_SETFD, flags | FD_CLOEXEC);
+    }
+
+    /* Leave signals to the main thread. */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (i = 0; i < DNS_THREADS; i++) {
+	if (pthread_create(&thread, NULL, resolver, NULL) != 0)
+	    panic("Couldn't start resolver thread.");
+	pthread_detach(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+static void *resolver(void *arg)
+{
+    Query *q;
+
+    for (;;) {
+	pthread_mutex_lock(&lock);
+	while (!todo)
+	    pthread_cond_wait(&wanted, &lock);
+	q = todo;
+	todo = q->next;
+	if (!todo)
+	    todo_tail = &todo;
+	pthread_mutex_unlock(&lock);
+
+	resolve(q);
+
+	pthread_mutex_lock(&lock);
+	q->next = done;
+	done = q;
+	pthread_mutex_unlock(&lock);
+
+	/* If the pipe is full, the main thread has a wakeup coming anyway. */
+	write(wakeup[1], "", 1);
+    }
+    return NULL;
+}
+
+/* Fill in q->answer.  A failed reverse lookup answers with the address; a
+ * failed forward lookup answers "-1". */
+static void resolve(Query *q)
+{
+    struct sockaddr_in sin;
+    struct addrinfo hints, *res;
+
+    if (q->reverse) {
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = inet_addr(q->name);
+	if (getnameinfo((struct sockaddr *) &sin, sizeof(sin), q->answer,
+			ANSWER_SIZE, NULL, 0, NI_NAMEREQD) != 0)
+	    sprintf(q->answer, "%.*s", ANSWER_SIZE - 1, q->name);
+    } else {
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	if (getaddrinfo(q->name, NULL, &hints, &res) == 0) {
+	    inet_ntop(AF_INET, &((struct sockaddr_in *) res->ai_addr)->sin_addr,
+		      q->answer, ANSWER_SIZE);
+	    freeaddrinfo(res);
+	} else {
+	    strcpy(q->answer, "-1");
+	}
+    }
+}
+
+static void cache_answer(Query *q, String *answer)
+{
+    Entry *entry;
+    int ind;
+
+    ind = hash(q->name) % CACHE_SIZE;
+    entry = EMALLOC(Entry, 1);
+    entry->reverse = q->reverse;
+    entry->name = tstrdup(q->name);
+    entry->answer = string_dup(answer);
+    entry->expires = time(NULL) + DNS_CACHE_TTL;
+    entry->next = cache[ind];
+    cache[ind] = entry;
+}
+
@@ -0,0 +1,13 @@
+/* dns.h: Declarations for the asynchronous name resolver. */
+
+#ifndef DNS_H
+#define DNS_H
+
+#include "cmstring.h"
+
+String *dns_lookup(char *name, int reverse);
+int dns_fd(void);
+void dns_deliver(void);
+
+#endif
+
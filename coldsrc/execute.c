@@ -22,20 +22,25 @@
 #include "lookup.h"
 
 #define STACK_STARTING_SIZE		(256 - STACK_MALLOC_DELTA)
+#define STACK_SEGMENT_RESERVE		32
 #define ARG_STACK_STARTING_SIZE		(32 - ARG_STACK_MALLOC_DELTA)
 
 extern int running;
 
 static void execute(void);
+static int *loop_costs(Method *method);
+static int next_opcode(long *opcodes, int pos);
 static void out_of_ticks_error(void);
 
 static Frame *frame_store = NULL;
+static Stack_segment *segment_store = NULL;
 static int frame_depth;
 static int last_argpos;
 String *numargs_str;
 
 Frame *cur_frame, *suspend_frame;
 Connection *cur_conn;
+Stack_segment *stack_seg;
 Data *stack;
 int stack_pos, stack_size;
 int *arg_starts, arg_pos, arg_size;
@@ -87,16 +92,91 @@ void pop(int n)
   }
 }
 
+/* Grow the current segment.  Only the frames living in this segment move;
+ * calls normally open a new segment (see segment_enter()) instead. */
 void check_stack(int n)
 {
-  Data *olds = NULL;
-  while (stack_pos + n > stack_size) {
+  if (stack_pos + n > stack_size) {
+    while (stack_pos + n > stack_size)
       stack_size = stack_size * 2 + STACK_MALLOC_DELTA;
-      olds = stack;
-      stack = EREALLOC(stack, Data, stack_size);
+    stack = EREALLOC(stack, Data, stack_size);
+    stack_seg->stack = stack;
+    stack_seg->stack_size = stack_size;
   }
 }
 
+/* Get a segment with room for at least size elements, preferring one we
+ * have already allocated. */
+static Stack_segment *segment_new(int size)
+{
+  Stack_segment *seg;
+
+  if (segment_store) {
+    seg = segment_store;
+    segment_store = seg->next;
+    if (seg->stack_size < size) {
+      seg->stack_size = size;
+      seg->stack = EREALLOC(seg->stack, Data, size);
+    }
+  } else {
+    seg = EMALLOC(Stack_segment, 1);
+    seg->stack_size = (size > STACK_STARTING_SIZE) ? size : STACK_STARTING_SIZE;
+    seg->stack = EMALLOC(Data, seg->stack_size);
+  }
+  seg->stack_pos = 0;
+  seg->prev = seg->next = NULL;
+  return seg;
+}
+
+/* Give any segments above the current one back to segment_store. */
+static void segment_trim(void)
+{
+  Stack_segment *seg;
+
+  while ((seg = stack_seg->next)) {
+    stack_seg->next = seg->next;
+    seg->next = segment_store;
+    segment_store = seg;
+  }
+}
+
+/* Move the top n elements of the stack into the next segment, which is
+ * made big enough to hold them and need more besides, and make it current.
+ * The elements from stack_start up are considered popped from this one. */
+static void segment_enter(int stack_start, int n, int need)
+{
+  Stack_segment *seg = stack_seg->next;
+  int i, size = n + need + STACK_SEGMENT_RESERVE;
+
+  if (!seg) {
+    seg = segment_new(size);
+    seg->prev = stack_seg;
+    stack_seg->next = seg;
+  } else if (seg->stack_size < size) {
+    seg->stack_size = size;
+    seg->stack = EREALLOC(seg->stack, Data, size);
+  }
+
+  MEMCPY(seg->stack, &stack[stack_pos - n], n);
+  for (i = stack_start; i < stack_pos - n; i++)
+    data_discard(&stack[i]);
+  stack_seg->stack_pos = stack_start;
+
+  stack_seg = seg;
+  stack = seg->stack;
+  stack_size = seg->stack_size;
+  stack_pos = n;
+}
+
+/* Return to the segment seg, which is below the current one. */
+static void segment_leave(Stack_segment *seg)
+{
+  stack_seg = seg;
+  stack = seg->stack;
+  stack_size = seg->stack_size;
+  stack_pos = seg->stack_pos;
+}
+
 void push_data(Data *d)
 {
   if (debugging & DEB_STACK)
@@ -241,8 +321,8 @@ void store_stack(void) {
 /*    write_log("store_stack:  allocating holder %d", holder); */
   }
   
-  holder->stack = stack;
-  holder->stack_size = stack_size;
+  segment_trim();
+  holder->stack_seg = stack_seg;
 
   holder->arg_starts = arg_starts;
   holder->arg_size = arg_size;
@@ -264,11 +344,12 @@ VMState *suspend_vm(void) {
   }
 
   vm->paused = 0;
+  vm->dns_wait = 0;
   vm->cur_frame = cur_frame;
   vm->cur_conn = cur_conn;
-  vm->stack = stack;
+  segment_trim();
+  vm->stack_seg = stack_seg;
   vm->stack_pos = stack_pos;
-  vm->stack_size = stack_size;
   vm->arg_starts = arg_starts;
   vm->arg_pos = arg_pos;
   vm->arg_size = arg_size;
@@ -282,9 +363,10 @@ void restore_vm(VMState *vm) {
   task_id = vm->task_id;
   cur_frame = vm->cur_frame;
   cur_conn = vm->cur_conn;
-  stack = vm->stack;
+  stack_seg = vm->stack_seg;
+  stack = stack_seg->stack;
+  stack_size = stack_seg->stack_size;
   stack_pos = vm->stack_pos;
-  stack_size = vm->stack_size;
   arg_starts = vm->arg_starts;
   arg_pos = vm->arg_pos;
   arg_size = vm->arg_size;
@@ -333,6 +415,23 @@ VMState *task_lookup(long tid) {
   return NULL;
 }
 
+/* conn is about to be freed.  Tasks that were started by it and are waiting
+ * to be resumed carry on without a connection. */
+void task_forget_connection(Connection *conn) {
+  VMState *vm;
+
+  for (vm = tasks;  vm;  vm = vm->next)
+    if (vm->cur_conn == conn)
+      vm->cur_conn = NULL;
+
+  for (vm = paused;  vm;  vm = vm->next)
+    if (vm->cur_conn == conn)
+      vm->cur_conn = NULL;
+
+  if (cur_conn == conn)
+    cur_conn = NULL;
+}
+
 /* we assume tid is a non-paused task */
 void task_resume(long tid, Data *ret) {
   VMState *vm = task_lookup(tid), *old_vm;
@@ -361,6 +460,16 @@ void task_suspend(void) {
   cur_frame = NULL;
 }
 
+/* Like task_suspend(), but only dns_deliver() may resume the task. */
+void task_wait_dns(void) {
+  VMState *vm = suspend_vm();
+
+  vm->dns_wait = 1;
+  ADD_TO_LIST(tasks, vm);
+  init_execute();
+  cur_frame = NULL;
+}
+
 void task_cancel(long tid) {
   VMState *vm = task_lookup(tid), *old_vm;
 
@@ -464,8 +573,7 @@ void init_execute()
   if (stack_store) {
     VMStack *holder;
     
-    stack = stack_store->stack;
-    stack_size = stack_store->stack_size;
+    stack_seg = stack_store->stack_seg;
 
     arg_starts = stack_store->arg_starts;
     arg_size = stack_store->arg_size;
@@ -476,13 +584,14 @@ void init_execute()
     holder_store = holder;
 /*    write_log("resuing execution state"); */
   } else {
-    stack = EMALLOC(Data, STACK_STARTING_SIZE);
-    stack_size = STACK_STARTING_SIZE;
+    stack_seg = segment_new(STACK_STARTING_SIZE);
 
     arg_starts = EMALLOC(int, ARG_STACK_STARTING_SIZE);
     arg_size = ARG_STACK_STARTING_SIZE;
 /*    write_log("allocating execution state"); */
   }
+  stack = stack_seg->stack;
+  stack_size = stack_seg->stack_size;
   stack_pos = 0;
   arg_pos = 0;
   opcode_restart = 0;
@@ -610,6 +719,14 @@ long frame_start(Object *obj, Method *method, Dbref sender, Data *rep, Dbref cal
     frame->specifiers = NULL;
     frame->handler_info = NULL;
 
+    /* If the locals won't fit in this segment, carry the arguments over into
+     * the next one; the frame then addresses everything relative to it. */
+    frame->caller_seg = stack_seg;
+    if (stack_pos + method->num_vars + STACK_SEGMENT_RESERVE > stack_size) {
+	segment_enter(stack_start, stack_pos - arg_start, method->num_vars);
+	stack_start = arg_start = 0;
+    }
+
     /* Set up stack indices. */
     frame->stack_start = stack_start;
     frame->var_start = arg_start;
@@ -623,6 +740,12 @@ long frame_start(Object *obj, Method *method, Dbref sender, Data *rep, Dbref cal
     }
     stack_pos += method->num_vars;
 
+    /* Charge the caller a tick for the call.  If this runs it out of ticks,
+     * it dies at its next loop test. */
+    tick++;
+    if (cur_frame)
+	cur_frame->ticks--;
+
     frame->caller_frame = cur_frame;
     cur_frame = frame;
     opcode_restart = 0;
@@ -677,6 +800,8 @@ void frame_return(void)
       data_discard(&stack[i]);
     }
     stack_pos = cur_frame->stack_start;
+    if (cur_frame->caller_seg != stack_seg)
+	segment_leave(cur_frame->caller_seg);
 
     /* Let go of method and objects. */
     cache_discard(cur_frame->object);
@@ -714,30 +839,27 @@ static void execute(void)
 {
     int opcode;
 
+    /* Ticks are charged by loop tests and method calls, not here; see
+     * charge_loop() and frame_start(). */
     while (cur_frame) {
-       tick++;
-	if (!--(cur_frame->ticks)) {
-	    out_of_ticks_error();
+	opcode = cur_frame->opcodes[cur_frame->pc];
+
+	if (debugging & DEB_OPCODE)
+	  debug_output();
+	if (debugging & DEB_PROFILE)
+	  startTimer();
+
+	last_argpos = arg_pos;	/* for opcode restart */
+	cur_frame->last_pc = cur_frame->pc;
+	cur_frame->pc++;
+	if (opcode_restart) {
+	  (*op_table[opcode].func)();
+	  opcode_restart = 0;
 	} else {
-	    opcode = cur_frame->opcodes[cur_frame->pc];
-
-	    if (debugging & DEB_OPCODE)
-	      debug_output();
-	    if (debugging & DEB_PROFILE)
-	      startTimer();
-
-	    last_argpos = arg_pos;	/* for opcode restart */
-	    cur_frame->last_pc = cur_frame->pc;
-	    cur_frame->pc++;
-	    if (opcode_restart) {
-	      (*op_table[opcode].func)();
-	      opcode_restart = 0;
-	    } else {
-	      (*op_table[opcode].func)();
-	    }
-	    if (debugging & DEB_PROFILE)
-	      cur_frame->profile += stopTimer();
+	  (*op_table[opcode].func)();
 	}
+	if (debugging & DEB_PROFILE)
+	  cur_frame->profile += stopTimer();
     }
 }
 
@@ -1434,6 +1556,81 @@ void user_error(Ident error, String *explanation, Data *arg)
     propagate_error(construct_traceback(error, explanation, arg, location), error);
 }
 
+/* Requires: The last opcode fetched is a FOR_RANGE, FOR_LIST or WHILE.
+ * Modifies: tick, cur_frame, and the method's table of loop costs.
+ * Effects: Charges the current frame for one pass through the loop.  If
+ *	    that leaves it out of ticks, throws an out-of-ticks error and
+ *	    returns 1; otherwise returns 0. */
+int charge_loop(void)
+{
+    Method *method = cur_frame->method;
+    int cost;
+
+    if (!method->loop_costs)
+	method->loop_costs = loop_costs(method);
+    cost = method->loop_costs[cur_frame->last_pc];
+
+    tick += cost;
+    cur_frame->ticks -= cost;
+    if (cur_frame->ticks <= 0) {
+	out_of_ticks_error();
+	return 1;
+    }
+    return 0;
+}
+
+/* Effects: Returns a table giving, at the position of each loop head in
+ *	    method's code, the number of opcodes in one pass through the loop
+ *	    (including its test).  Both arms of a conditional count, but
+ *	    comments, the bodies of inner loops, which charge for themselves,
+ *	    and the code an ADD_TAIL skips when it appends, don't. */
+static int *loop_costs(Method *method)
+{
+    long *opcodes = method->opcodes;
+    int *costs, head, pos, end, op, cost;
+
+    costs = EMALLOC(int, method->num_opcodes);
+    for (pos = 0; pos < method->num_opcodes; pos++)
+	costs[pos] = 0;
+
+    for (head = 0; head < method->num_opcodes; head = next_opcode(opcodes, head)) {
+	op = opcodes[head];
+	if (op != FOR_RANGE && op != FOR_LIST && op != WHILE)
+	    continue;
+
+	/* A WHILE loop's test starts with its condition expression. */
+	pos = (op == WHILE) ? opcodes[head + 2] : head;
+	end = opcodes[head + 1];
+	cost = 0;
+	while (pos < end) {
+	    op = opcodes[pos];
+	    if (pos != head && (op == FOR_RANGE || op == FOR_LIST || op == WHILE)) {
+		cost++;
+		pos = opcodes[pos + 1];
+		continue;
+	    }
+	    if (op == ADD_TAIL) {
+		cost++;
+		pos = opcodes[pos + 1];
+		continue;
+	    }
+	    if (op != COMMENT)
+		cost++;
+	    pos = next_opcode(opcodes, pos);
+	}
+	costs[head] = cost;
+    }
+    return costs;
+}
+
+/* Effects: Returns the position of the opcode following the one at pos. */
+static int next_opcode(long *opcodes, int pos)
+{
+    Op_info *info = &op_table[opcodes[pos]];
+
+    return pos + 1 + (info->arg1 != 0) + (info->arg2 != 0);
+}
+
 static void out_of_ticks_error(void)
 {
     static String *explanation;
@@ -1458,7 +1655,6 @@ static void out_of_ticks_error(void)
     if (!explanation)
       explanation = string_from_chars("Out of ticks", 12);
     propagate_error(construct_traceback(methoderr_id, explanation, NULL, location), methoderr_id);
-    list_discard(location);
 }
 
 int check_perms()
@@ -8,6 +8,7 @@ typedef struct error_action_specifier Error_action_specifier;
 typedef struct handler_info Handler_info;
 typedef struct vmstate VMState;
 typedef struct vmstack VMStack;
+typedef struct stack_segment Stack_segment;
 
 #include <sys/types.h>
 #include <stdlib.h>
@@ -21,9 +22,19 @@ typedef struct vmstack VMStack;
 #define STACK_MALLOC_DELTA 4
 #define ARG_STACK_MALLOC_DELTA 8
 
-struct vmstack {
+/* The data stack is a chain of segments.  A frame's locals and temporaries
+ * all live in one segment; a call which would overflow the current segment
+ * moves its arguments into the next one instead of growing the whole stack.
+ * stack, stack_pos and stack_size always describe the current segment. */
+struct stack_segment {
   Data *stack;
   int stack_size;
+  int stack_pos;		/* saved stack_pos while a later segment is active */
+  Stack_segment *prev, *next;
+};
+
+struct vmstack {
+  Stack_segment *stack_seg;
   int *arg_starts, arg_size;
   VMStack *next;
 };
@@ -31,11 +42,12 @@ struct vmstack {
 struct vmstate {
     Frame *cur_frame;
     Connection *cur_conn;
-    Data *stack;
-    int stack_pos, stack_size;
+    Stack_segment *stack_seg;
+    int stack_pos;
     int *arg_starts, arg_pos, arg_size;
     int task_id;
     int paused;
+    int dns_wait;	/* suspended until dns_deliver() has its answer */
     VMState *next;
 };
 
@@ -53,6 +65,7 @@ struct frame {
     int stack_start;
     int var_start;
     int argpos_start;
+    Stack_segment *caller_seg;	/* segment to return to */
     Error_action_specifier *specifiers;
     Handler_info *handler_info;
     Frame *caller_frame;
@@ -88,6 +101,7 @@ struct handler_info {
 
 extern Frame *cur_frame;
 extern Connection *cur_conn;
+extern Stack_segment *stack_seg;
 extern Data *stack;
 extern int stack_pos, stack_size;
 extern int *arg_starts, arg_pos, arg_size;
@@ -103,6 +117,7 @@ void task_method(Connection *conn, Object *obj, Method *method);
 long frame_start(Object *obj, Method *method, Dbref sender, Data *rep, Dbref caller,
 		 int stack_start, int arg_start, int arg_pos);
 void frame_return(void);
+int charge_loop(void);
 void anticipate_assignment(void);
 Ident pass_message(int stack_start, int arg_start);
 Ident send_message(Dbref dbref, Ident message, Data *rep, int stack_start, int arg_start);
@@ -147,10 +162,12 @@ void propagate_error(List *traceback, Ident error);
 void pop_error_action_specifier(void);
 void pop_handler_info(void);
 void task_suspend();
+void task_wait_dns(void);
 void task_resume(long tid, Data *ret);
 void task_cancel(long tid);
 void task_pause(void);
 VMState *task_lookup(long tid);
+void task_forget_connection(Connection *conn);
 List *task_list(void);
 void run_paused_tasks();
 List *task_callers(void);
@@ -115,6 +115,11 @@ extern Pile *compiler_pile;	/* We free this pile after compilation. */
 /* Reserved for future use. */
 %token ATOMIC NON_ATOMIC
 
+/* Opcodes added since.  They come last so that the opcodes stored in
+ * existing binary databases keep their numbers. */
+%token AGGREGATE AGGREGATE_END SWITCH_TABLE ADD_TAIL REGEXP_STATS BROADCAST
+%token SET_OUTPUT_LIMITS OUTPUT_STATS SET_LINE_MODE
+
 /* LAST_TOKEN tells opcodes.c how much space to allocate for the opcodes
  * table. */
 %token LAST_TOKEN
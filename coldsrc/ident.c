@@ -20,6 +20,7 @@ typedef struct ident_entry Ident_entry;
 
 struct ident_entry {
     char *s;
+    unsigned long hval;		/* hash(s), kept so we needn't recompute it */
     int refs;
     long next;
 };
@@ -35,7 +36,7 @@ Ident ticks_id, connect_id, disconnect_id, startup_id, parse_id, socket_id;
 Ident bind_id, servnf_id, paramexists_id, dictionary_id, keynf_id, address_id;
 Ident refused_id, net_id, timeout_id, other_id, failed_id, heartbeat_id;
 Ident regexp_id, buffer_id, namenf_id, salt_id, function_id, opcode_id;
-Ident method_id, interpreter_id, catch_id, transmit_id;
+Ident method_id, interpreter_id, catch_id, transmit_id, overflow_id;
 
 #ifndef NDEBUG
 int ident_check(Ident id)
@@ -113,6 +114,7 @@ void init_ident(void)
     interpreter_id = ident_get("interpreter");
     catch_id = ident_get("catch");
     transmit_id = ident_get("transmit");
+    overflow_id = ident_get("overflow");
 }
 
 
@@ -161,7 +163,7 @@ Ident ident_get(char *s)
 
 	/* Install old symbols in hash table. */
 	for (i = 0; i < tab_size; i++) {
-	    ind = hash(tab[i].s) % new_size;
+	    ind = tab[i].hval % new_size;
 	    tab[i].next = hashtab[ind];
 	    hashtab[ind] = i;
 	}
@@ -173,6 +175,7 @@ Ident ident_get(char *s)
     ind = blanks;
     blanks = tab[ind].next;
     tab[ind].s = tstrdup(s);
+    tab[ind].hval = hval;
     tab[ind].refs = 1;
     tab[ind].next = hashtab[hval % tab_size];
     hashtab[hval % tab_size] = ind;
@@ -195,7 +198,7 @@ void ident_discard(Ident id)
 #endif
     if (!tab[id].refs) {
 	/* Get the hash table thread for this entry. */
-	ind = hash(tab[id].s) % tab_size;
+	ind = tab[id].hval % tab_size;
 
 	/* Free the string. */
 	tfree_chars(tab[id].s);
@@ -229,6 +232,12 @@ char *ident_name(Ident id)
     return tab[id].s;
 }
 
+/* Effects: Returns hash(ident_name(id)), without recomputing it. */
+unsigned long ident_hash(Ident id)
+{
+    return tab[id].hval;
+}
+
 Ident type2id(int type)
 {
     switch (type) {
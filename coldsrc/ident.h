@@ -16,12 +16,14 @@ extern Ident servnf_id, paramexists_id, dictionary_id, keynf_id, address_id;
 extern Ident refused_id, net_id, timeout_id, other_id, failed_id;
 extern Ident heartbeat_id, regexp_id, buffer_id, namenf_id, salt_id;
 extern Ident function_id, opcode_id, method_id, interpreter_id, catch_id, transmit_id;
+extern Ident overflow_id;
 
 void init_ident(void);
 Ident ident_get(char *s);
 void ident_discard(Ident id);
 Ident ident_dup(Ident id);
 char *ident_name(Ident id);
+unsigned long ident_hash(Ident id);
 int ident_check(Ident id);
 Ident type2id(int type);
 
@@ -9,6 +9,11 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <fcntl.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <time.h>
 
 #include "x.tab.h"
 #include "io.h"
@@ -20,12 +25,42 @@
 #include "data.h"
 #include "util.h"
 #include "ident.h"
+#include "dns.h"
+#include "config.h"
 
-#define BUF_SIZE 1024
+#define BUF_SIZE 4096		/* Input buffer size to begin with. */
+#define MERGE_MAX 4096		/* Copy short output onto the previous buffer. */
+#define MAX_IOV 64		/* Most buffers written by one writev(). */
+#define DBREF_HASH_SIZE 1024
+
+/* Ask the kernel to hold a partial packet when more output follows. */
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
+
+/* Telnet commands, and where frame_lines() is in one. */
+#define IAC	255
+#define SB	250
+#define WILL	251
+#define SE	240
+#define TELNET_DATA	0
+#define TELNET_IAC	1	/* After IAC. */
+#define TELNET_OPTION	2	/* After IAC WILL, WONT, DO or DONT. */
+#define TELNET_SB	3	/* In a subnegotiation. */
+#define TELNET_SB_IAC	4	/* After IAC in a subnegotiation. */
 
 static void connection_read(Connection *conn);
 static void connection_write(Connection *conn);
+static void write_queued(Connection *conn);
 static void connection_discard(Connection *conn);
+static void queue_output(Connection *conn, Buffer *buf);
+static void discard_output(Connection *conn);
+static void drop_oldest(Connection *conn);
+static List *frame_lines(Connection *conn, Buffer *buf);
+static void line_add(Connection *conn, unsigned char *s, int len);
+static List *line_end(Connection *conn, List *lines);
+static void index_add(Connection *conn);
+static void index_remove(Connection *conn);
 static void pend_discard(Pending *pend);
 static void server_discard(Server *serv);
 static Connection *connection_add(int fd, long dbref, char pipe);
@@ -34,19 +69,43 @@ static Connection *connections;		/* List of client connections. */
 static Server *servers;			/* List of server sockets. */
 static Pending *pendings;		/* List of pending connections. */
 
-/* Notify the system object of any dead connections and delete them. */
+/* Connections hashed by dbref, so that tell() and boot() needn't look at
+ * everyone else's. */
+static Connection *by_dbref[DBREF_HASH_SIZE];
+
+static long output_queued;		/* Bytes queued on all connections. */
+static long output_dropped;		/* Bytes dropped by drop_oldest(). */
+
+static Connection *dirty;		/* Output queued since the last flush. */
+static int flushing;			/* In flush_queued_output(). */
+
+static long write_calls;		/* Calls to sendmsg() and writev(). */
+static long flushes;			/* Calls to flush_queued_output(). */
+static long loop_writes;		/* Write calls since the last flush began,
+					 * i.e. in this trip round the loop. */
+
+static Buffer *input;			/* Reused by connection_read(). */
+static int input_size = BUF_SIZE;	/* Space in input, when it's reused. */
+
+/* Notify the system object of any dead connections and delete them.  Tell
+ * the objects of connections whose output has passed the high mark. */
 void flush_defunct(void)
 {
     Connection **connp, *conn;
     Server **servp, *serv;
     Pending **pendp, *pend;
+    Data d;
 
     connp = &connections;
     while (*connp) {
 	conn = *connp;
-	if (conn->flags.dead
-	    && conn->write_buf
-	    && conn->write_buf->len == 0) {
+	if (conn->flags.overflow == 1 && !conn->flags.dead) {
+	    conn->flags.overflow = 2;
+	    d.type = INTEGER;
+	    d.u.val = conn->out_len;
+	    task(conn, conn->dbref, overflow_id, 1, &d);
+	}
+	if (conn->flags.dead && !conn->flags.nowrite && !conn->out) {
 	  *connp = conn->next;
 	  connection_discard(conn);
 	} else {
@@ -82,21 +141,21 @@ void flush_defunct(void)
  * wait forever. */
 void handle_io_events(long sec)
 {
-    Connection *conn;
+    Connection *conn, *ready;
     Server *serv;
+    Client *client;
     Pending *pend;
     String *str;
     Data d1, d2;
 
     /* Call io_event_wait() to wait for something to happen.  The return value
-     * is nonzero if an I/O event occurred.  If thre is a new connection, then
-     * *fd will be set to the descriptor of the new connection; otherwise, it
-     * is set to -1. */
-    if (!io_event_wait(sec, connections, servers, pendings))
+     * is nonzero if an I/O event occurred.  Connections with events are
+     * chained onto ready; new connections are queued on their servers. */
+    if (!io_event_wait(sec, connections, servers, pendings, &ready))
 	return;
 
     /* Deal with any events on our existing connections. */
-    for (conn = connections; conn; conn = conn->next) {
+    for (conn = ready; conn; conn = conn->next_ready) {
 	if (conn->flags.readable && !conn->flags.dead)
 	    connection_read(conn);
 	if (conn->flags.writable)
@@ -105,17 +164,19 @@ void handle_io_events(long sec)
 
     /* Look for new connections on the server sockets. */
     for (serv = servers; serv; serv = serv->next) {
-	if (serv->client_socket == -1)
-	    continue;
-	conn = connection_add(serv->client_socket, serv->dbref, 0);
-	serv->client_socket = -1;
-	str = string_from_chars(serv->client_addr, strlen(serv->client_addr));
-	d1.type = STRING;
-	d1.u.str = str;
-	d2.type = INTEGER;
-	d2.u.val = serv->client_port;
-	task(conn, conn->dbref, connect_id, 2, &d1, &d2);
-	string_discard(str);
+	while (serv->clients) {
+	    client = serv->clients;
+	    serv->clients = client->next;
+	    conn = connection_add(client->fd, serv->dbref, 0);
+	    str = string_from_chars(client->addr, strlen(client->addr));
+	    d1.type = STRING;
+	    d1.u.str = str;
+	    d2.type = INTEGER;
+	    d2.u.val = client->port;
+	    task(conn, conn->dbref, connect_id, 2, &d1, &d2);
+	    string_discard(str);
+	    free(client);
+	}
     }
 
     /* Look for pending connections succeeding or failing. */
@@ -127,6 +188,7 @@ void handle_io_events(long sec)
 		d1.u.val = pend->task_id;
 		task(conn, conn->dbref, connect_id, 1, &d1);
 	    } else {
+		unwatch_fd(pend->fd);
 		close(pend->fd);
 		d1.type = INTEGER;
 		d1.u.val = pend->task_id;
@@ -136,16 +198,36 @@ void handle_io_events(long sec)
 	    }
 	}
     }
+
+    /* Resume tasks waiting on name lookups. */
+    dns_deliver();
 }
 
-void tell(long dbref, Buffer *buf)
+/* Queue buf for output on dbref's connections.  Returns the number of
+ * connections it was queued on. */
+int tell(long dbref, Buffer *buf)
 {
     Connection *conn;
+    int count = 0;
 
-    for (conn = connections; conn; conn = conn->next) {
-	if (conn->dbref == dbref && !conn->flags.dead && conn->write_buf)
-	    conn->write_buf = buffer_append(conn->write_buf, buf);
+    conn = by_dbref[(unsigned long) dbref % DBREF_HASH_SIZE];
+    for (; conn; conn = conn->next_dbref) {
+	if (conn->dbref == dbref && !conn->flags.dead && !conn->flags.nowrite) {
+	    queue_output(conn, buf);
+	    count++;
+
+	    /* Leave the output for flush_queued_output() to write with the
+	     * rest of this iteration's, unless that's where we are now. */
+	    if (flushing) {
+		watch_connection(conn);
+	    } else if (!conn->flags.dirty) {
+		conn->flags.dirty = 1;
+		conn->next_dirty = dirty;
+		dirty = conn;
+	    }
+	}
     }
+    return count;
 }
 
 int boot(long dbref)
@@ -153,9 +235,11 @@ int boot(long dbref)
     Connection *conn;
     int count = 0;
 
-    for (conn = connections; conn; conn = conn->next) {
+    conn = by_dbref[(unsigned long) dbref % DBREF_HASH_SIZE];
+    for (; conn; conn = conn->next_dbref) {
 	if (conn->dbref == dbref) {
 	    conn->flags.dead = 1;
+	    watch_connection(conn);
 	    count++;
 	}
     }
@@ -183,12 +267,13 @@ int add_server(int port, long dbref)
 
     cnew = EMALLOC(Server, 1);
     cnew->server_socket = server_socket;
-    cnew->client_socket = -1;
+    cnew->clients = NULL;
     cnew->port = port;
     cnew->dbref = dbref;
     cnew->dead = 0;
     cnew->next = servers;
     servers = cnew;
+    watch_server(cnew);
 
     return 1;
 }
@@ -209,40 +294,93 @@ int remove_server(int port)
 
 static void connection_read(Connection *conn)
 {
-    unsigned char temp[BUF_SIZE + 1];
-    int len;
     Buffer *buf;
+    List *lines;
+    int len, total = 0, err = 0;
     Data d;
-    /*    static int counter = 1;*/
 
-    len = read(conn->fd, (char *) temp, BUF_SIZE);
-    if (len < 0 && errno == EINTR) {
-	/* We were interrupted; deal with this next time around. */
-	return;
+    /* Read straight into the input buffer, unless the last .parse() kept
+     * hold of it. */
+    if (input && input->refs > 1) {
+	buffer_discard(input);
+	input = NULL;
+    }
+    if (!input) {
+	input = buffer_new(input_size);
+    } else {
+	/* The last delivery shortened it; its space is still there. */
+	input->len = input_size;
+    }
+    buf = input;
+
+    /* Take everything the connection has sent, up to READ_BUDGET bytes.
+     * A short read means we've emptied it.  Standard input may block, so it
+     * only gets one read. */
+    for (;;) {
+	if (total == input_size) {
+	    if (input_size >= READ_BUDGET || conn->flags.nowrite)
+		break;
+	    input_size = (input_size * 2 > READ_BUDGET) ? READ_BUDGET
+						       : input_size * 2;
+	    buf = input = buffer_truncate(buf, input_size);
+	}
+	len = read(conn->fd, (char *) buf->s + total, input_size - total);
+	if (len <= 0) {
+	    err = (len < 0) ? errno : 0;
+	    break;
+	}
+	total += len;
+	if (total < input_size)
+	    break;
     }
-    conn->flags.readable = 0;
 
-    if (len <= 0) {
+    if (!total) {
+	if (err == EINTR) {
+	    /* We were interrupted; deal with this next time around. */
+	    return;
+	}
+	conn->flags.readable = 0;
+	if (err == EAGAIN) {
+	    /* Nothing there after all; accepted sockets don't block. */
+	    return;
+	}
+
 	/* The connection closed. */
 	conn->flags.dead = 1;
+	watch_connection(conn);
 	return;
     }
-#if 0
-counter++;
-temp[len] = '\0';
-fprintf(stderr, "Coldread %d (%d) %s for %04x\n", counter, len, temp, conn->dbref);
-if (conn->dbref) bkpt();
-#endif
-    /* We successfully read some data.  Handle it. */
-    buf = buffer_new(len);
-    MEMCPY(buf->s, temp, len);
-    d.type = BUFFER;
-    d.u.buffer = buf;
-    task(conn, conn->dbref, parse_id, 1, &d);
-#if 0
-fprintf(stderr, "Delivered buffer %04x to dbref %04x\n", d, conn->dbref);
-#endif
-    buffer_discard(buf);
+    conn->flags.readable = 0;
+
+    /* We successfully read some data.  Hand it all to one task; the buffer
+     * comes back to us afterwards unless the task kept it.  In line mode,
+     * the task gets the lines it finished, if any. */
+    buf->len = total;
+    if (conn->flags.lines) {
+	lines = frame_lines(conn, buf);
+	if (lines) {
+	    d.type = LIST;
+	    d.u.list = lines;
+	    task(conn, conn->dbref, parse_id, 1, &d);
+	    list_discard(lines);
+	}
+    } else {
+	d.type = BUFFER;
+	d.u.buffer = buf;
+	task(conn, conn->dbref, parse_id, 1, &d);
+    }
+
+    /* A kept buffer holds on to all of its space, so don't make the next
+     * one so large. */
+    if (input->refs > 1)
+	input_size = BUF_SIZE;
+
+    /* If the read that stopped us found the end, the connection is gone;
+     * we'd only find that out again next time. */
+    if (len <= 0 && err != EAGAIN && err != EINTR) {
+	conn->flags.dead = 1;
+	watch_connection(conn);
+    }
 }
 
 #if 0
@@ -252,26 +390,15 @@ static void bkpt() {
 
 static void connection_write(Connection *conn)
 {
-    Buffer *buf = conn->write_buf;
-    int r;
-
-    r = write(conn->fd, buf->s, buf->len);
     conn->flags.writable = 0;
+    if (!conn->out)
+	return;
 
-    if (r <= 0) {
-	/* We lost the connection. */
-	conn->flags.dead = 1;
-	buf = buffer_truncate(buf, 0);
-    } else {
-	MEMMOVE(buf->s, buf->s + r, buf->len - r);
-	buf = buffer_truncate(buf, buf->len - r);
-    }
-
-    conn->write_buf = buf;
+    write_queued(conn);
+    watch_connection(conn);
 
     /* call back the connection object to tell it of empty TX buffer */
-    if (conn->flags.writecallback
-	&& (conn->write_buf->len == 0)) {
+    if (conn->flags.writecallback && !conn->out) {
       long result = task(conn, conn->dbref, transmit_id, 0, (Data*)0);
 #if 0
       if (result == methodnf_id)
@@ -280,31 +407,162 @@ static void connection_write(Connection *conn)
     }
 }
 
+/* Write as much of conn's queued output as the kernel will take, a batch of
+ * buffers to a call.  Every batch but the last is marked MSG_MORE so that
+ * the kernel can fill whole packets. */
+static void write_queued(Connection *conn)
+{
+    struct iovec iov[MAX_IOV];
+    struct msghdr msg;
+    Segment *seg;
+    int n, r, len, wrote;
+
+    while (conn->out) {
+	n = len = 0;
+	for (seg = conn->out; seg && n < MAX_IOV; seg = seg->next) {
+	    iov[n].iov_base = (char *) seg->buf->s;
+	    iov[n].iov_len = seg->buf->len;
+	    len += seg->buf->len;
+	    n++;
+	}
+	iov[0].iov_base = (char *) iov[0].iov_base + conn->out_pos;
+	iov[0].iov_len -= conn->out_pos;
+	len -= conn->out_pos;
+
+	write_calls++;
+	loop_writes++;
+	if (!conn->flags.notsock) {
+	    memset(&msg, 0, sizeof(msg));
+	    msg.msg_iov = iov;
+	    msg.msg_iovlen = n;
+	    r = sendmsg(conn->fd, &msg, (seg) ? MSG_MORE : 0);
+	    if (r < 0 && errno == ENOTSOCK) {
+		/* Standard output, or a pipe; use writev() from now on. */
+		conn->flags.notsock = 1;
+		r = writev(conn->fd, iov, n);
+	    }
+	} else {
+	    r = writev(conn->fd, iov, n);
+	}
+
+	if (r < 0 && (errno == EINTR || errno == EAGAIN)) {
+	    /* Nothing written; try again when it is next writable. */
+	    return;
+	} else if (r <= 0) {
+	    /* We lost the connection. */
+	    conn->flags.dead = 1;
+	    discard_output(conn);
+	    return;
+	}
+
+	wrote = r;
+	conn->out_len -= r;
+	output_queued -= r;
+	if (conn->flags.overflow && conn->out_len < conn->out_low)
+	    conn->flags.overflow = 0;
+
+	/* Release the buffers we finished, and remember how far we got into
+	 * the next one. */
+	r += conn->out_pos;
+	while (conn->out && r >= conn->out->buf->len) {
+	    seg = conn->out;
+	    r -= seg->buf->len;
+	    conn->out = seg->next;
+	    buffer_discard(seg->buf);
+	    free(seg);
+	}
+	if (!conn->out)
+	    conn->out_last = NULL;
+	conn->out_pos = r;
+
+	/* A short write means the kernel's buffer is full. */
+	if (wrote < len)
+	    return;
+    }
+}
+
 static Connection *connection_add(int fd, long dbref, char pipe)
 {
     Connection *conn;
 
     conn = EMALLOC(Connection, 1);
     conn->fd = fd;
-    conn->write_buf = buffer_new(0);
+    conn->out = conn->out_last = NULL;
+    conn->out_pos = 0;
+    conn->out_len = 0;
+    conn->out_high = OUTPUT_HIGH_WATER;
+    conn->out_low = OUTPUT_LOW_WATER;
     conn->dbref = dbref;
     conn->flags.readable = 0;
     conn->flags.writable = 0;
     conn->flags.dead = 0;
     conn->flags.pipe = pipe;
     conn->flags.writecallback = 1;	/* assume it wants callback */
+    conn->flags.nowrite = 0;
+    conn->flags.dropold = 0;
+    conn->flags.overflow = 0;
+    conn->flags.lines = 0;
+    conn->flags.cr = 0;
+    conn->flags.dirty = 0;
+    conn->flags.notsock = 0;
+    conn->line = NULL;
+    conn->telnet = TELNET_DATA;
     conn->next = connections;
     connections = conn;
+    index_add(conn);
+    watch_connection(conn);
     return conn;
 }
 
+/* Turn line mode on or off for conn.  A partial line is thrown away. */
+void connection_line_mode(Connection *conn, int on)
+{
+    conn->flags.lines = on;
+    conn->flags.cr = 0;
+    conn->telnet = TELNET_DATA;
+    if (conn->line) {
+	string_discard(conn->line);
+	conn->line = NULL;
+    }
+}
+
+/* Hand conn over to a new object. */
+void connection_assign(Connection *conn, Dbref dbref)
+{
+    index_remove(conn);
+    conn->dbref = dbref;
+    index_add(conn);
+}
+
+static void index_add(Connection *conn)
+{
+    Connection **bucket;
+
+    bucket = &by_dbref[(unsigned long) conn->dbref % DBREF_HASH_SIZE];
+    conn->next_dbref = *bucket;
+    *bucket = conn;
+}
+
+/* Take conn out of the index, if it is there. */
+static void index_remove(Connection *conn)
+{
+    Connection **connp;
+
+    connp = &by_dbref[(unsigned long) conn->dbref % DBREF_HASH_SIZE];
+    for (; *connp; connp = &(*connp)->next_dbref) {
+	if (*connp == conn) {
+	    *connp = conn->next_dbref;
+	    return;
+	}
+    }
+}
+
 void init_io(void)
 {
   Connection *c;
   fcntl(0, O_NONBLOCK);
   c = connection_add(0, 0, 0);
-  buffer_discard(c->write_buf);
-  c->write_buf = 0;
+  c->flags.nowrite = 1;
 
   fcntl(1, O_NONBLOCK);
   connection_add(1, 0, 0);
@@ -312,19 +570,202 @@ void init_io(void)
 
 static void connection_discard(Connection *conn)
 {
-    /* Notify system object that the connection is gone. */
+    /* Notify system object that the connection is gone.  Nothing should
+     * find the connection from now on, even if the system object assigns it
+     * elsewhere. */
+    Connection **connp;
+
+    index_remove(conn);
     task(conn, conn->dbref, disconnect_id, 0);
+    index_remove(conn);
+
+    /* A task may have suspended holding conn, e.g. in hostname(). */
+    task_forget_connection(conn);
+
+    if (conn->flags.dirty) {
+	for (connp = &dirty; *connp != conn; connp = &(*connp)->next_dirty);
+	*connp = conn->next_dirty;
+    }
 
     /* Free the data associated with the connection. */
+    unwatch_fd(conn->fd);
     close(conn->fd);
     if (conn->flags.pipe)
       wait(0);	/* clean up zombie */
 
-    if (conn->write_buf)
-      buffer_discard(conn->write_buf);
+    discard_output(conn);
+    if (conn->line)
+	string_discard(conn->line);
     free(conn);
 }
 
+/* Split buf into lines for a connection in line mode, keeping a partial line
+ * for next time.  Lines end at CR, LF or CR LF; telnet commands and
+ * unprintable characters are dropped.  Returns the finished lines, or NULL if
+ * there are none. */
+static List *frame_lines(Connection *conn, Buffer *buf)
+{
+    List *lines = NULL;
+    unsigned char *p, *end, *run = NULL;
+    int c;
+
+    end = buf->s + buf->len;
+    for (p = buf->s; p < end; p++) {
+	c = *p;
+
+	/* Printable text goes onto the line a run at a time. */
+	if (conn->telnet == TELNET_DATA && isprint(c)) {
+	    if (!run) {
+		run = p;
+		conn->flags.cr = 0;
+	    }
+	    continue;
+	}
+	if (run) {
+	    line_add(conn, run, p - run);
+	    run = NULL;
+	}
+
+	switch (conn->telnet) {
+
+	  case TELNET_DATA:
+	    if (c == '\n' && conn->flags.cr) {
+		/* The second half of CR LF. */
+		conn->flags.cr = 0;
+	    } else if (c == '\n' || c == '\r') {
+		lines = line_end(conn, lines);
+		conn->flags.cr = (c == '\r');
+	    } else {
+		conn->flags.cr = 0;
+		if (c == IAC)
+		    conn->telnet = TELNET_IAC;
+	    }
+	    break;
+
+	  case TELNET_IAC:
+	    /* IAC IAC is a literal 255, which isn't printable anyway. */
+	    if (c == SB)
+		conn->telnet = TELNET_SB;
+	    else if (c >= WILL && c != IAC)
+		conn->telnet = TELNET_OPTION;
+	    else
+		conn->telnet = TELNET_DATA;
+	    break;
+
+	  case TELNET_OPTION:
+	    conn->telnet = TELNET_DATA;
+	    break;
+
+	  case TELNET_SB:
+	    if (c == IAC)
+		conn->telnet = TELNET_SB_IAC;
+	    break;
+
+	  case TELNET_SB_IAC:
+	    conn->telnet = (c == SE) ? TELNET_DATA : TELNET_SB;
+	    break;
+	}
+    }
+    if (run)
+	line_add(conn, run, p - run);
+
+    /* Don't let a client with no line endings fill our memory. */
+    if (conn->line && string_length(conn->line) >= READ_BUDGET)
+	lines = line_end(conn, lines);
+
+    return lines;
+}
+
+static void line_add(Connection *conn, unsigned char *s, int len)
+{
+    if (conn->line)
+	conn->line = string_add_chars(conn->line, (char *) s, len);
+    else
+	conn->line = string_from_chars((char *) s, len);
+}
+
+/* Add conn's line, which may be empty, to lines. */
+static List *line_end(Connection *conn, List *lines)
+{
+    Data d;
+
+    if (!lines)
+	lines = list_new(0);
+    d.type = STRING;
+    d.u.str = (conn->line) ? conn->line : string_new(0);
+    lines = list_add(lines, &d);
+    string_discard(d.u.str);
+    conn->line = NULL;
+    return lines;
+}
+
+/* Queue buf for output on conn.  Buffers are queued by reference, except
+ * that short output is copied onto the last queued buffer when nothing else
+ * refers to it, so that a stream of short lines stays a short chain. */
+static void queue_output(Connection *conn, Buffer *buf)
+{
+    Segment *seg = conn->out_last;
+
+    if (!buf->len)
+	return;
+
+    if (seg && seg->buf->refs == 1 && seg->buf->len + buf->len <= MERGE_MAX) {
+	seg->buf = buffer_append(seg->buf, buf);
+    } else {
+	seg = EMALLOC(Segment, 1);
+	seg->buf = buffer_dup(buf);
+	seg->next = NULL;
+	if (conn->out_last)
+	    conn->out_last->next = seg;
+	else
+	    conn->out = seg;
+	conn->out_last = seg;
+    }
+    conn->out_len += buf->len;
+    output_queued += buf->len;
+
+    /* Connections that drop old output are told only if dropping couldn't
+     * get them back under the mark. */
+    if (conn->out_len > conn->out_high && conn->flags.dropold)
+	drop_oldest(conn);
+    if (conn->out_len > conn->out_high && !conn->flags.overflow)
+	conn->flags.overflow = 1;
+}
+
+/* Drop whole buffers from the front of conn's queue until it is back under
+ * its high mark, sparing a partly written buffer and the newest one. */
+static void drop_oldest(Connection *conn)
+{
+    Segment **segp, *seg;
+
+    segp = (conn->out_pos) ? &conn->out->next : &conn->out;
+    while (conn->out_len > conn->out_high && *segp && (*segp)->next) {
+	seg = *segp;
+	*segp = seg->next;
+	conn->out_len -= seg->buf->len;
+	output_queued -= seg->buf->len;
+	output_dropped += seg->buf->len;
+	buffer_discard(seg->buf);
+	free(seg);
+    }
+}
+
+static void discard_output(Connection *conn)
+{
+    Segment *seg;
+
+    while (conn->out) {
+	seg = conn->out;
+	conn->out = seg->next;
+	buffer_discard(seg->buf);
+	free(seg);
+    }
+    conn->out_last = NULL;
+    conn->out_pos = 0;
+    output_queued -= conn->out_len;
+    conn->out_len = 0;
+}
+
 static void pend_discard(Pending *pend)
 {
     free(pend);
@@ -332,6 +773,7 @@ static void pend_discard(Pending *pend)
 
 static void server_discard(Server *serv)
 {
+    unwatch_fd(serv->server_socket);
     close(serv->server_socket);
 }
 
@@ -362,30 +804,81 @@ long make_connection(char *addr, int port, Dbref receiver)
     cnew->error = result;
     cnew->next = pendings;
     pendings = cnew;
+    watch_pending(cnew);
     return NOT_AN_IDENT;
 }
 
-/* Write out everything in connections' write buffers.  Called by main()
- * before exiting; does not modify the write buffers to reflect writing. */
+/* Write the output tell() has queued since the last call, so that each trip
+ * around the main loop costs one write per connection rather than one per
+ * tell().  Output the kernel won't take yet waits for the connection to
+ * become writable.  Returns nonzero if a dead connection has finished its
+ * output, and so is waiting to be discarded. */
+int flush_queued_output(void)
+{
+    Connection *conn, *next;
+    int finished = 0;
+
+    flushes++;
+    loop_writes = 0;
+    flushing = 1;
+    conn = dirty;
+    dirty = NULL;
+    for (; conn; conn = next) {
+	next = conn->next_dirty;
+	conn->flags.dirty = 0;
+	connection_write(conn);
+	if (conn->flags.dead && !conn->out)
+	    finished = 1;
+    }
+    flushing = 0;
+    return finished;
+}
+
+/* Write out everything in connections' output queues.  Called by main()
+ * before exiting, so it runs no tasks, and gives clients FLUSH_TIMEOUT
+ * seconds to take their output. */
 void flush_output(void)
 {
     Connection *conn;
-    unsigned char *s;
-    int len, r;
-
-    for (conn = connections; conn; conn = conn->next) {
-      if (conn->write_buf) {
-	s = conn->write_buf->s;
-	len = conn->write_buf->len;
-	while (len) {
-	    r = write(conn->fd, s, len);
-	    if (r <= 0)
-		break;
-	    len -= r;
-	    s += r;
+    struct pollfd *fds;
+    time_t deadline;
+    int n, count;
+
+    for (count = 0, conn = connections; conn; conn = conn->next)
+	count++;
+    fds = EMALLOC(struct pollfd, count + 1);
+    deadline = time(NULL) + FLUSH_TIMEOUT;
+
+    for (;;) {
+	n = 0;
+	for (conn = connections; conn; conn = conn->next) {
+	    if (!conn->out)
+		continue;
+	    write_queued(conn);
+	    if (conn->out) {
+		fds[n].fd = conn->fd;
+		fds[n].events = POLLOUT;
+		n++;
+	    }
 	}
-      }
+	if (!n || time(NULL) >= deadline)
+	    break;
+	poll(fds, n, (deadline - time(NULL)) * 1000);
     }
+    free(fds);
+}
+
+void io_output_stats(long *queued, long *dropped)
+{
+    *queued = output_queued;
+    *dropped = output_dropped;
+}
+
+void io_write_stats(long *writes, long *flush_count, long *last)
+{
+    *writes = write_calls;
+    *flush_count = flushes;
+    *last = loop_writes;
 }
 
 void op_connections(void)
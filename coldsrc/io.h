@@ -6,13 +6,21 @@
 typedef struct connection Connection;
 typedef struct server Server;
 typedef struct pending Pending;
+typedef struct client Client;
+typedef struct segment Segment;
 
 #include "cmstring.h"
 #include "data.h"
 
 struct connection {
     int fd;			/* File descriptor for input and output. */
-    Buffer *write_buf;		/* Buffer for network output. */
+    Segment *out;		/* Output not yet written, oldest first. */
+    Segment *out_last;
+    int out_pos;		/* Bytes of out->buf already written. */
+    long out_len;		/* Bytes queued and not yet written. */
+    long out_high, out_low;	/* Marks for overflow messages. */
+    String *line;		/* Partial input line, in line mode. */
+    char telnet;		/* Where we are in a telnet command. */
     Dbref dbref;		/* The player, usually. */
     struct {
       char readable;		/* Connection has new data pending. */
@@ -20,8 +28,19 @@ struct connection {
       char dead;		/* Connection is defunct. */
       char pipe;		/* Connection is a pipe */
       char writecallback;	/* Connection wants notification on write */
+      char nowrite;		/* Connection takes no output (stdin). */
+      char dropold;		/* Drop oldest output to stay under out_high. */
+      char overflow;		/* Output passed out_high: 1 until the object
+				 * is told, then 2 until below out_low. */
+      char lines;		/* Hand .parse() lines rather than buffers. */
+      char cr;			/* Last input line ended with a CR. */
+      char dirty;		/* On the list for flush_queued_output(). */
+      char notsock;		/* Not a socket, so no sendmsg(). */
     } flags;
     Connection *next;
+    Connection *next_ready;	/* Chain built by io_event_wait(). */
+    Connection *next_dbref;	/* Chain in io.c's index by dbref. */
+    Connection *next_dirty;	/* Chain of connections with new output. */
 };
 
 struct server {
@@ -29,12 +48,24 @@ struct server {
     unsigned short port;
     Dbref dbref;
     int dead;
-    int client_socket;
-    char client_addr[20];
-    unsigned short client_port;
+    Client *clients;		/* Accepted, but not yet announced. */
     Server *next;
 };
 
+/* Output buffers are shared with the database and with other connections;
+ * buffers are copied on write, so holding a reference is enough. */
+struct segment {
+    Buffer *buf;
+    Segment *next;
+};
+
+struct client {
+    int fd;
+    char addr[20];
+    unsigned short port;
+    Client *next;
+};
+
 struct pending {
     int fd;
     long task_id;
@@ -48,12 +79,17 @@ struct pending {
 void init_io(void);
 void flush_defunct(void);
 void handle_io_events(long sec);
-void tell(long dbref, Buffer *buf);
+int tell(long dbref, Buffer *buf);
+void connection_assign(Connection *conn, Dbref dbref);
+void connection_line_mode(Connection *conn, int on);
 int boot(long dbref);
 int add_server(int port, long dbref);
 int remove_server(int port);
 long make_connection(char *addr, int port, Dbref receiver);
+int flush_queued_output(void);
 void flush_output(void);
+void io_output_stats(long *queued, long *dropped);
+void io_write_stats(long *writes, long *flushes, long *last);
 
 #endif
 
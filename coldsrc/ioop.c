@@ -35,6 +35,134 @@ void op_echo(void)
     push_int(1);
 }
 
+/* Write a buffer to the connections of every object in a list.  Each
+ * connection's output queue shares the one buffer. */
+void op_broadcast(void)
+{
+    Data *args, *d;
+    List *dbrefs;
+    int i, count = 0;
+
+    /* Accept a list of dbrefs and a buffer. */
+    if (!func_init_2(&args, LIST, BUFFER))
+	return;
+    dbrefs = args[0].u.list;
+
+    /* Verify that all items in the list are dbrefs. */
+    for (d = list_first(dbrefs), i = 0; d; d = list_next(dbrefs, d), i++) {
+	if (d->type != DBREF) {
+	    cthrow(type_id, "Recipient %d (%D) is not a dbref.", i + 1, d);
+	    return;
+	}
+    }
+
+    /* Restrict to system object. */
+    if (check_perms())
+	return;
+
+    for (d = list_first(dbrefs); d; d = list_next(dbrefs, d))
+	count += tell(d->u.dbref, args[1].u.buffer);
+
+    /* Return the number of connections written to. */
+    pop(2);
+    push_int(count);
+}
+
+/* Set the high and low marks for the current connection's queued output, and
+ * whether to drop its oldest output rather than queue past the high mark.
+ * Returns 0 if there is no current connection. */
+void op_set_output_limits(void)
+{
+    Data *args;
+    int num_args;
+
+    /* Accept a high mark, a low mark, and an optional drop flag. */
+    if (!func_init_2_or_3(&args, &num_args, INTEGER, INTEGER, 0))
+	return;
+
+    if (args[0].u.val <= 0 || args[1].u.val < 0) {
+	cthrow(range_id, "Marks (%d and %d) must be positive.", args[0].u.val,
+	       args[1].u.val);
+	return;
+    }
+    if (args[1].u.val > args[0].u.val) {
+	cthrow(range_id, "Low mark (%d) is above high mark (%d).",
+	       args[1].u.val, args[0].u.val);
+	return;
+    }
+
+    /* Restrict to system object. */
+    if (check_perms())
+	return;
+
+    if (cur_conn) {
+	cur_conn->out_high = args[0].u.val;
+	cur_conn->out_low = args[1].u.val;
+	cur_conn->flags.dropold = (num_args == 3) ? data_true(&args[2]) : 0;
+	pop(num_args);
+	push_int(1);
+    } else {
+	pop(num_args);
+	push_int(0);
+    }
+}
+
+/* Return [queued, dropped, writes, flushes, loop writes]: the bytes of output
+ * queued on all connections, the bytes dropped so far to keep connections
+ * under their high marks, the write calls made so far, the times round the
+ * main loop that have flushed output, and the write calls made so far in
+ * this time round. */
+void op_output_stats(void)
+{
+    List *stats;
+    Data *d;
+    long queued, dropped, writes, flushes, loop_writes;
+    int i;
+
+    if (!func_init_0())
+	return;
+
+    io_output_stats(&queued, &dropped);
+    io_write_stats(&writes, &flushes, &loop_writes);
+    stats = list_new(5);
+    d = list_empty_spaces(stats, 5);
+    for (i = 0; i < 5; i++)
+	d[i].type = INTEGER;
+    d[0].u.val = queued;
+    d[1].u.val = dropped;
+    d[2].u.val = writes;
+    d[3].u.val = flushes;
+    d[4].u.val = loop_writes;
+    push_list(stats);
+    list_discard(stats);
+}
+
+/* Turn line mode on or off for the current connection.  In line mode,
+ * .parse() gets a list of the complete lines received, with line endings,
+ * telnet commands and unprintable characters removed.  Returns 0 if there is
+ * no current connection. */
+void op_set_line_mode(void)
+{
+    Data *args;
+    int on;
+
+    if (!func_init_1(&args, 0))
+	return;
+
+    /* Restrict to system object. */
+    if (check_perms())
+	return;
+
+    on = data_true(&args[0]);
+    pop(1);
+    if (cur_conn) {
+	connection_line_mode(cur_conn, on);
+	push_int(1);
+    } else {
+	push_int(0);
+    }
+}
+
 void op_echo_file(void)
 {
     size_t size, i, r;
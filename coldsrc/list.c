@@ -19,6 +19,45 @@
 #define MALLOC_DELTA	3
 #define STARTING_SIZE	(16 - MALLOC_DELTA)
 
+/* The set operations below search linearly when their lists have fewer than
+ * this many elements between them, and use a hash index otherwise.  They also
+ * search linearly when the list they'd scan once per element has at most
+ * SET_SCAN_MAX elements, as in union(big, [x]); a few scans of the other list
+ * cost less than indexing it, and allocate nothing. */
+#define SET_HASH_MIN	32
+#define SET_SCAN_MAX	4
+
+/* The second list_search() on a list with at least this many elements since
+ * the list last changed builds a hash index for it, which is kept until the
+ * list changes, so that repeated membership tests on a long list don't each
+ * scan it.  (Waiting for the second search keeps loops which search a list
+ * and then add to it from building an index they never use.) */
+#define SEARCH_HASH_MIN	32
+
+/* A sublist of a shared list at least VIEW_MIN elements long is a view: a
+ * List which shares its base's elements instead of duplicating them.  A view
+ * holds a reference to its base, so the base is never modified in place while
+ * the view is around, and the view itself is copied before it is modified. */
+#define VIEW_MIN	16
+
+/* A temporary hash index over an array of list elements.  Elements are
+ * numbered by their offset in el, and each chain is a linked list of element
+ * numbers threaded through next. */
+typedef struct list_index List_index;
+
+struct list_index {
+    Data *el;
+    int size;
+    int *chains;
+    int *next;
+};
+
+static void index_init(List_index *index, Data *el, int len);
+static void index_add(List_index *index, int i);
+static int index_find(List_index *index, Data *d, char *skip);
+static void index_free(List_index *index);
+static void forget_hash(List *list);
+
 #ifndef NDEBUG
 int list_check(List *l)
 {
@@ -54,12 +93,16 @@ static List *prepare_to_modify(List *list, int start, int len)
     List *cnew;
     int i, need_to_move, need_to_resize, size;
 
+    /* Whatever the caller does next will change the list's contents. */
+    forget_hash(list);
+
     /* Figure out if we need to resize the list or move its contents.  Moving
      * contents takes precedence. */
     need_to_resize = (len - start) * 4 < list->size;
     need_to_resize = need_to_resize && list->size > STARTING_SIZE;
     need_to_resize = need_to_resize || (list->size < len);
-    need_to_move = (list->refs > 1) || (need_to_resize && start > 0);
+    need_to_move = (list->refs > 1) || list->base;
+    need_to_move = need_to_move || (need_to_resize && start > 0);
 
     if (need_to_move) {
       /* Move the list contents into a new list. */
@@ -80,6 +123,7 @@ static List *prepare_to_modify(List *list, int start, int len)
       while (size < len)
 	size = size * 2 + MALLOC_DELTA;
       list = (List *)erealloc(list, sizeof(List) + (size * sizeof(Data)));
+      list->el = list->store;
       list->size = size;
       return list;
     } else {
@@ -110,6 +154,11 @@ List *list_new(int len)
     cnew->start = 0;
     cnew->size = size;
     cnew->refs = 1;
+    cnew->hashed = 0;
+    cnew->searches = 0;
+    cnew->index = NULL;
+    cnew->base = NULL;
+    cnew->el = cnew->store;
     return cnew;
 }
 
@@ -156,6 +205,7 @@ Data *list_elem(List *list, int i)
  * Don't manipulate <list> until you're done. */
 Data *list_empty_spaces(List *list, int spaces)
 {
+    forget_hash(list);
     list->len += spaces;
     return list->el + list->start + list->len - spaces;
 }
@@ -163,6 +213,25 @@ Data *list_empty_spaces(List *list, int spaces)
 int list_search(List *list, Data *data, int offset)
 {
     Data *d, *start, *end;
+    int i;
+
+    if (list->len >= SEARCH_HASH_MIN && (list->index || list->searches++)) {
+	if (!list->index) {
+	    list->index = EMALLOC(List_index, 1);
+	    index_init(list->index, list->el + list->start, list->len);
+
+	    /* Add the elements backwards, so that each chain runs forwards
+	     * and the first match we find is the first in the list. */
+	    for (i = list->len - 1; i >= 0; i--)
+		index_add(list->index, i);
+	}
+	i = list->index->chains[data_hash(data) % list->index->size];
+	for (; i != -1; i = list->index->next[i]) {
+	    if (i >= offset && data_cmp(data, &list->index->el[i]) == 0)
+		return i;
+	}
+	return -1;
+    }
 
     start = list_first(list) + offset;
     end = list_last(list);
@@ -223,6 +292,31 @@ int list_order(List *l1, List *l2)
 }
 
 /* Error-checking on pos is the job of the calling function. */
+/* Effects: Returns a hash of the elements of list, such that lists which
+ *	    list_cmp() finds equivalent hash alike.  The value is kept in the
+ *	    list until it is next modified. */
+unsigned long list_hash(List *list)
+{
+    Data *d, *end;
+    unsigned long hval;
+
+    if (list->hashed)
+	return list->hval;
+
+    if (list->len) {
+	hval = 0;
+	end = list->el + list->start + list->len;
+	for (d = list->el + list->start; d < end; d++)
+	    hval = hval * 31 + data_hash(d);
+    } else {
+	hval = 100;
+    }
+
+    list->hval = hval;
+    list->hashed = 1;
+    return hval;
+}
+
 List *list_insert(List *list, int pos, Data *elem)
 {
     list = prepare_to_modify(list, list->start, list->len + 1);
@@ -243,8 +337,9 @@ List *list_add(List *list, Data *elem)
 List *list_replace(List *list, int pos, Data *elem)
 {
   /* prepare_to_modify needed here only for multiply referenced lists */
-  if (list->refs > 1)
+  if (list->refs > 1 || list->base)
     list = prepare_to_modify(list, list->start, list->len);
+  forget_hash(list);
   pos += list->start;
   data_discard(&list->el[pos]);
   data_dup(&list->el[pos], elem);
@@ -259,8 +354,9 @@ List *list_delete(List *list, int pos)
     return prepare_to_modify(list, list->start, list->len - 1);
 
   /* prepare_to_modify needed here only for multiply referenced lists */
-  if (list->refs > 1)
+  if (list->refs > 1 || list->base)
     list = prepare_to_modify(list, list->start, list->len);
+  forget_hash(list);
 
   pos += list->start;
   data_discard(&list->el[pos]);
@@ -303,8 +399,9 @@ List *list_reverse(List *list)
   int i;
 
   /* prepare_to_modify needed here only for multiply referenced lists */
-  if (list->refs > 1)
+  if (list->refs > 1 || list->base)
     list = prepare_to_modify(list, list->start, list->len);
+  forget_hash(list);
 
   d = list->el + list->start;
   for (i = 0; i < list->len / 2; i++) {
@@ -335,8 +432,35 @@ List *list_setremove(List *list, Data *d)
 /* convert list to set */
 List *list_toset(List *list)
 {
-  int li, pos;
-  Data *d;
+  int li, pos, len;
+  Data *d, *el;
+  List *cnew;
+  List_index index;
+
+  if (list->len >= SET_HASH_MIN) {
+    /* Index each element which isn't a duplicate of an earlier one, and copy
+     * those into a new list if there were any duplicates. */
+    el = list->el + list->start;
+    index_init(&index, el, list->len);
+    for (li = 0, len = 0; li < list->len; li++) {
+      if (index_find(&index, &el[li], NULL) == -1) {
+	index_add(&index, li);
+	len++;
+      }
+    }
+    if (len < list->len) {
+      cnew = list_new(len);
+      cnew->len = len;
+      for (li = 0, pos = 0; li < list->len; li++) {
+	if (index_find(&index, &el[li], NULL) == li)
+	  data_dup(&cnew->el[pos++], &el[li]);
+      }
+      list_discard(list);
+      list = cnew;
+    }
+    index_free(&index);
+    return list;
+  }
 
   for (li = 0; li < list->len; li++) {
     d = list_elem(list, li);
@@ -353,9 +477,33 @@ List *list_toset(List *list)
 List *list_union(List *list1, List *list2)
 {
     Data *start, *end, *d;
+    List_index index1, index2;
+    int i;
+
+    if (list1->len + list2->len >= SET_HASH_MIN &&
+	list2->len > SET_SCAN_MAX) {
+	/* Index list1, and the elements of list2 we've decided to add, and
+	 * then add those elements. */
+	start = list2->el + list2->start;
+	index_init(&index1, list1->el + list1->start, list1->len);
+	for (i = list1->len - 1; i >= 0; i--)
+	    index_add(&index1, i);
+	index_init(&index2, start, list2->len);
+	for (i = 0; i < list2->len; i++) {
+	    if (index_find(&index1, &start[i], NULL) == -1 &&
+		index_find(&index2, &start[i], NULL) == -1)
+		index_add(&index2, i);
+	}
+	for (i = 0; i < list2->len; i++) {
+	    if (index_find(&index2, &start[i], NULL) == i)
+		list1 = list_add(list1, &start[i]);
+	}
+	index_free(&index1);
+	index_free(&index2);
+	return list1;
+    }
 
-    /* Simplistic O(len1 * len2) implementation for now.  Later, use lengths to
-     * decide whether to use a O(len1 + len2) hash table algorithm. */
+    /* Simplistic O(len1 * len2) implementation for small lists. */
     start = list2->el + list2->start;
     end = start + list2->len;
     for (d = start; d < end; d++) {
@@ -370,11 +518,66 @@ List *list_union(List *list1, List *list2)
  */
 List *list_factor(List *list1, List *list2)
 {
-    Data *dl1, *inter, *dl2;
-    int i, pos;
+    Data *dl1, *inter, *dl2, *el1, *el2;
+    int i, pos, len1, len2;
+    char *used1, *used2;
+    List_index index;
     List *factor = list_new(3);
     list_empty_spaces(factor, 3);
 
+    if (list1->len + list2->len >= SET_HASH_MIN &&
+	list1->len > SET_SCAN_MAX && list2->len > SET_SCAN_MAX) {
+	/* Match each element of list2, from last to first, against the first
+	 * unmatched equal element of list1, as the linear version below does,
+	 * and then split the lists according to which elements matched. */
+	el1 = list1->el + list1->start;
+	el2 = list2->el + list2->start;
+	used1 = EMALLOC(char, list1->len + 1);
+	used2 = EMALLOC(char, list2->len + 1);
+	for (i = 0; i < list1->len; i++)
+	    used1[i] = 0;
+	index_init(&index, el1, list1->len);
+	for (i = list1->len - 1; i >= 0; i--)
+	    index_add(&index, i);
+
+	inter = list_elem(factor, 1);
+	inter->type = LIST;
+	inter->u.list = list_new(list1->len + list2->len);
+	len1 = list1->len;
+	len2 = list2->len;
+	for (i = list2->len - 1; i >= 0; i--) {
+	    pos = index_find(&index, &el2[i], used1);
+	    used2[i] = (pos != -1);
+	    if (pos != -1) {
+		used1[pos] = 1;
+		inter->u.list = list_add(inter->u.list, &el2[i]);
+		len1--;
+		len2--;
+	    }
+	}
+	index_free(&index);
+
+	dl1 = list_elem(factor, 0);
+	dl1->type = LIST;
+	dl1->u.list = list_new(len1);
+	for (i = 0; i < list1->len; i++) {
+	    if (!used1[i])
+		dl1->u.list = list_add(dl1->u.list, &el1[i]);
+	}
+
+	dl2 = list_elem(factor, 2);
+	dl2->type = LIST;
+	dl2->u.list = list_new(len2);
+	for (i = 0; i < list2->len; i++) {
+	    if (!used2[i])
+		dl2->u.list = list_add(dl2->u.list, &el2[i]);
+	}
+
+	free(used1);
+	free(used2);
+	return factor;
+    }
+
     dl1 = list_elem(factor, 0);
     dl1->type = LIST;
     dl1->u.list = list_dup(list1);
@@ -387,7 +590,7 @@ List *list_factor(List *list1, List *list2)
     dl2->type = LIST;
     dl2->u.list = list_dup(list2);
 
-    for (i = dl2->u.list->len; i >= 0; i--) {
+    for (i = dl2->u.list->len - 1; i >= 0; i--) {
       pos = list_search(dl1->u.list, list_elem(dl2->u.list, i), 0);
       if (pos != -1) {
 	/* in intersection - move it and remove it */
@@ -399,6 +602,64 @@ List *list_factor(List *list1, List *list2)
     return factor;
 }
 
+/* Modifies: index.
+ * Effects: Initializes an empty index over the len elements at el. */
+static void index_init(List_index *index, Data *el, int len)
+{
+    int i;
+
+    index->el = el;
+    index->size = len * 2 + 1;
+    index->chains = EMALLOC(int, index->size);
+    index->next = EMALLOC(int, len + 1);
+    for (i = 0; i < index->size; i++)
+	index->chains[i] = -1;
+}
+
+/* Modifies: index.
+ * Effects: Adds element i to the front of its chain, so that elements added
+ *	    in decreasing order are found in increasing order. */
+static void index_add(List_index *index, int i)
+{
+    int ind = data_hash(&index->el[i]) % index->size;
+
+    index->next[i] = index->chains[ind];
+    index->chains[ind] = i;
+}
+
+/* Effects: Returns the first element in index equal to d, passing over any
+ *	    element i for which skip[i] is set, or -1 if there is none. */
+static int index_find(List_index *index, Data *d, char *skip)
+{
+    int i;
+
+    i = index->chains[data_hash(d) % index->size];
+    for (; i != -1; i = index->next[i]) {
+	if ((!skip || !skip[i]) && data_cmp(&index->el[i], d) == 0)
+	    return i;
+    }
+    return -1;
+}
+
+static void index_free(List_index *index)
+{
+    free(index->chains);
+    free(index->next);
+}
+
+/* Drop the hash value and index we may have kept for list, since its contents
+ * are about to change. */
+static void forget_hash(List *list)
+{
+    list->hashed = 0;
+    list->searches = 0;
+    if (list->index) {
+	index_free(list->index);
+	free(list->index);
+	list->index = NULL;
+    }
+}
+
 List *list_qsort(List *list)
 {
   list = prepare_to_modify(list, list->start, list->len);
@@ -408,6 +669,30 @@ List *list_qsort(List *list)
 
 List *list_sublist(List *list, int start, int len)
 {
+    List *view;
+
+    if ((list->refs > 1 || list->base) && len >= VIEW_MIN) {
+	if (list->refs == 1) {
+	    /* Narrow the view in place. */
+	    list->start += start;
+	    list->len = len;
+	    forget_hash(list);
+	    return list;
+	}
+	view = EMALLOC(List, 1);
+	view->start = list->start + start;
+	view->len = len;
+	view->refs = 1;
+	view->hashed = 0;
+	view->searches = 0;
+	view->index = NULL;
+	view->base = list_dup(list->base ? list->base : list);
+	view->el = view->base->el;
+	view->size = view->base->size;
+	list_discard(list);
+	return view;
+    }
+
     return prepare_to_modify(list, list->start + start, len);
 }
 
@@ -417,8 +702,13 @@ void list_discard(List *list)
     int i;
 
     if (!--list->refs) {
-	for (i = list->start; i < list->start + list->len; i++)
-	    data_discard(&list->el[i]);
+	forget_hash(list);
+	if (list->base) {
+	    list_discard(list->base);
+	} else {
+	    for (i = list->start; i < list->start + list->len; i++)
+		data_discard(&list->el[i]);
+	}
 	free(list);
     }
 }
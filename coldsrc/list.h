@@ -21,7 +21,13 @@ struct list {
     int len;
     int size;
     int refs;
-    Data el[1];
+    int hashed;			/* Nonzero if hval is valid. */
+    unsigned long hval;		/* Cached list_hash(), cleared on change. */
+    int searches;		/* list_search() calls since the last change. */
+    struct list_index *index;	/* Built by list_search(), dropped on change. */
+    List *base;			/* For a view, the list whose elements it shares. */
+    Data *el;			/* base->el for a view, or else store. */
+    Data store[1];
 };
 
 List *list_new(int len);
@@ -36,6 +42,7 @@ Data *list_empty_spaces(List *list, int spaces);
 int list_search(List *list, Data *data, int offset);
 int list_cmp(List *l1, List *l2);
 int list_order(List *l1, List *l2);
+unsigned long list_hash(List *list);
 List *list_insert(List *list, int pos, Data *elem);
 List *list_add(List *list, Data *elem);
 List *list_replace(List *list, int pos, Data *elem);
@@ -176,6 +176,11 @@ static void main_loop(void)
 	    seconds = (paused ? 0 : seconds);
 	}
 
+	/* Write out the output queued so far.  If that lets a dead connection
+	 * go, come straight back round to discard it. */
+	if (flush_queued_output())
+	    seconds = 0;
+
 	/* Handle any I/O events waiting. */
 	handle_io_events(seconds);
 
@@ -6,6 +6,7 @@
  * 1035 - domain name system */
 
 #define _BSD 44 /* For RS6000s. */
+#define _GNU_SOURCE /* For accept4(). */
 
 #include <unistd.h>
 #include <stdio.h>
@@ -39,12 +40,22 @@
 #include "log.h"
 #include "util.h"
 #include "ident.h"
+#include "memory.h"
+#include "config.h"
+#include "dns.h"
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
 
 extern int socket(), bind(), listen(), getdtablesize(), select(), accept();
 extern int connect(), getpeername(), getsockopt(), setsockopt();
 extern void bzero();
 
 static long translate_connect_error(int error);
+static void set_non_blocking(int fd);
+static void accept_clients(Server *serv);
+static void check_pending(Pending *pend);
 
 static struct sockaddr_in sockin;		/* An internet address. */
 static int addr_size = sizeof(sockin);	/* Size of sockin. */
@@ -78,24 +89,374 @@ int get_server_socket(int port)
     }
 
     /* Start listening on port.  This shouldn't return an error under any
-     * circumstances. */
-    listen(fd, 8);
+     * circumstances.  Let the kernel hold as many clients as it will while
+     * we work through them. */
+    listen(fd, SOMAXCONN);
+
+    /* Set the socket non-blocking, so that we can accept until the backlog
+     * is empty. */
+    set_non_blocking(fd);
 
     return fd;
 }
 
+static void set_non_blocking(int fd)
+{
+    int flags;
+
+    flags = fcntl(fd, F_GETFL);
+#ifdef FNDELAY
+    flags |= FNDELAY;
+#else
+#ifdef O_NDELAY
+    flags |= O_NDELAY;
+#endif
+#endif
+    fcntl(fd, F_SETFL, flags);
+}
+
+/* Accept the clients waiting on serv's socket, up to MAX_ACCEPTS of them, and
+ * queue them on serv for handle_io_events() to announce.  Client sockets are
+ * non-blocking and closed for a run_script() operation. */
+static void accept_clients(Server *serv)
+{
+    Client *client, **tail;
+    int fd, count;
+#ifndef SOCK_CLOEXEC
+    int flags;
+#endif
+
+    for (tail = &serv->clients; *tail; tail = &(*tail)->next);
+
+    for (count = 0; count < MAX_ACCEPTS; count++) {
+	addr_size = sizeof(sockin);
+#ifdef SOCK_CLOEXEC
+	fd = accept4(serv->server_socket, (struct sockaddr *) &sockin,
+		     &addr_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+	fd = accept(serv->server_socket, (struct sockaddr *) &sockin,
+		    &addr_size);
+	if (fd >= 0) {
+	    set_non_blocking(fd);
+#ifdef FD_CLOEXEC
+	    flags = fcntl(fd, F_GETFD);
+	    flags |= FD_CLOEXEC;
+	    fcntl(fd, F_SETFD, flags);
+#endif
+	}
+#endif
+
+	/* Stop when the backlog is empty; on other errors, leave the rest for
+	 * the next pass. */
+	if (fd < 0)
+	    break;
+
+	client = EMALLOC(Client, 1);
+	client->fd = fd;
+	strcpy(client->addr, inet_ntoa(sockin.sin_addr));
+	client->port = ntohs(sockin.sin_port);
+	client->next = NULL;
+	*tail = client;
+	tail = &client->next;
+    }
+}
+
+/* A pending connection became writable; see if the connect succeeded. */
+static void check_pending(Pending *pend)
+{
+    int result, error, dummy = sizeof(int);
+
+    result = getpeername(pend->fd, (struct sockaddr *) &sockin, &addr_size);
+    if (result == 0) {
+	pend->error = NOT_AN_IDENT;
+    } else {
+	error = EOPNOTSUPP;  /* in case this is a unix domain */
+	getsockopt(pend->fd, SOL_SOCKET, SO_ERROR, (char *) &error, &dummy);
+	pend->error = translate_connect_error(error);
+    }
+    pend->finished = 1;
+}
+
+#ifdef USE_EPOLL
+
+/* Descriptors stay registered with epoll between calls to io_event_wait();
+ * io.c tells us when a connection's interest changes, so a wakeup costs time
+ * in proportion to the number of ready descriptors, not the number of
+ * connections. */
+
+#define MAX_EVENTS	256
+
+/* What a watched descriptor belongs to. */
+#define WATCH_NONE		0
+#define WATCH_CONNECTION	1
+#define WATCH_SERVER		2
+#define WATCH_PENDING		3
+#define WATCH_DNS		4
+
+/* Whether a watched descriptor is in the epoll set. */
+#define EPOLL_OUT		0
+#define EPOLL_IN		1
+#define EPOLL_REFUSED		2
+
+typedef struct watch Watch;
+
+struct watch {
+    char kind;
+    char state;
+    unsigned int events;	/* Events we want to hear about. */
+    void *owner;		/* The Connection, Server or Pending. */
+};
+
+static int epoll_fd = -1;
+static Watch *watches;		/* Indexed by descriptor. */
+static int watches_size;
+static int *refused;		/* Descriptors epoll would not accept. */
+static int refused_count, refused_size;
+
+static void open_epoll(void)
+{
+    int flags;
+
+    epoll_fd = epoll_create(MAX_EVENTS);
+    if (epoll_fd == -1)
+	panic("epoll_create() failed");
+#ifdef FD_CLOEXEC
+    flags = fcntl(epoll_fd, F_GETFD);
+    flags |= FD_CLOEXEC;
+    fcntl(epoll_fd, F_SETFD, flags);
+#endif
+}
+
+static void watch(int fd, int kind, void *owner, unsigned int events)
+{
+    struct epoll_event ev;
+    Watch *w;
+    int i, size;
+
+    if (epoll_fd == -1)
+	open_epoll();
+
+    if (fd >= watches_size) {
+	size = (watches_size) ? watches_size : 64;
+	while (size <= fd)
+	    size *= 2;
+	watches = EREALLOC(watches, Watch, size);
+	for (i = watches_size; i < size; i++)
+	    watches[i].kind = WATCH_NONE;
+	watches_size = size;
+    }
+
+    w = &watches[fd];
+    if (w->kind == WATCH_NONE)
+	w->state = EPOLL_OUT;
+    w->kind = kind;
+    w->owner = owner;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (w->state == EPOLL_REFUSED) {
+	/* Nothing to tell the kernel; io_event_wait() polls these itself. */
+    } else if (!events) {
+	/* epoll reports hangups even with an empty mask, so drop descriptors
+	 * we have no interest in. */
+	if (w->state == EPOLL_IN)
+	    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+	w->state = EPOLL_OUT;
+    } else if (w->state == EPOLL_OUT) {
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+	    w->state = EPOLL_IN;
+	} else {
+	    /* Regular files and the like can't be polled; select() always
+	     * reports them ready, and so do we. */
+	    w->state = EPOLL_REFUSED;
+	    if (refused_count == refused_size) {
+		refused_size = (refused_size) ? refused_size * 2 : 8;
+		refused = EREALLOC(refused, int, refused_size);
+	    }
+	    refused[refused_count++] = fd;
+	}
+    } else if (w->events != events) {
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+    }
+    w->events = events;
+}
+
+/* Update the events we wait for on conn.  Called whenever conn's dead flag
+ * or the emptiness of its output queue may have changed. */
+void watch_connection(Connection *conn)
+{
+    unsigned int events = 0;
+
+    if (!conn->flags.dead)
+	events |= EPOLLIN;
+    if (conn->out)
+	events |= EPOLLOUT;
+    watch(conn->fd, WATCH_CONNECTION, conn, events);
+}
+
+void watch_server(Server *serv)
+{
+    watch(serv->server_socket, WATCH_SERVER, serv, EPOLLIN);
+}
+
+void watch_pending(Pending *pend)
+{
+    if (pend->error == NOT_AN_IDENT)
+	watch(pend->fd, WATCH_PENDING, pend, EPOLLOUT);
+}
+
+/* Stop watching fd.  Must be called before fd is closed. */
+void unwatch_fd(int fd)
+{
+    struct epoll_event ev;
+    Watch *w;
+    int i;
+
+    if (fd < 0 || fd >= watches_size || watches[fd].kind == WATCH_NONE)
+	return;
+
+    w = &watches[fd];
+    if (w->state == EPOLL_IN) {
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+    } else if (w->state == EPOLL_REFUSED) {
+	for (i = 0; refused[i] != fd; i++);
+	refused[i] = refused[--refused_count];
+    }
+    w->kind = WATCH_NONE;
+}
+
 /* Wait for I/O events.  sec is the number of seconds we can wait before
- * returning, or -1 if we can wait forever.  Returns nonzero if an I/O event
+ * returning, or -1 if we can wait forever.  Ready connections are chained
+ * through next_ready onto *ready.  Returns nonzero if an I/O event
  * happened. */
 int io_event_wait(long sec, Connection *connections, Server *servers,
-		  Pending *pendings)
+		  Pending *pendings, Connection **ready)
+{
+    struct epoll_event events[MAX_EVENTS];
+    Connection *conn, **tail = ready;
+    Pending *pend;
+    Watch *w;
+    int i, fd, count, timeout, happened = 0;
+
+    if (epoll_fd == -1)
+	open_epoll();
+
+    /* Finished name lookups are signalled on a pipe. */
+    fd = dns_fd();
+    if (fd != -1 && (fd >= watches_size || watches[fd].kind == WATCH_NONE))
+	watch(fd, WATCH_DNS, NULL, EPOLLIN);
+
+    /* The connect has already failed; just set the finished bit. */
+    for (pend = pendings; pend; pend = pend->next) {
+	if (pend->error != NOT_AN_IDENT)
+	    pend->finished = 1;
+    }
+
+    /* Descriptors epoll refused are always ready. */
+    for (i = 0; i < refused_count; i++) {
+	w = &watches[refused[i]];
+	if (w->kind != WATCH_CONNECTION || !w->events)
+	    continue;
+	conn = (Connection *) w->owner;
+	if (w->events & EPOLLIN)
+	    conn->flags.readable = 1;
+	if (w->events & EPOLLOUT)
+	    conn->flags.writable = 1;
+	*tail = conn;
+	tail = &conn->next_ready;
+	happened = 1;
+    }
+
+    if (happened) {
+	timeout = 0;
+    } else if (sec == -1) {
+	timeout = -1;
+        /* this is a rather odd thing to happen for me */
+        write_log("select:  forever wait");
+    } else {
+	timeout = sec * 1000;
+    }
+
+    count = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+
+    /* Lose horribly if epoll_wait() fails on anything but an interrupted
+     * system call. */
+    if (count == -1 && errno != EINTR)
+	panic("epoll_wait() failed");
+
+    for (i = 0; i < count; i++) {
+	w = &watches[events[i].data.fd];
+	switch (w->kind) {
+
+	  case WATCH_CONNECTION:
+	    /* Hangups and errors show up on whichever side we asked about, as
+	     * they do with select(). */
+	    conn = (Connection *) w->owner;
+	    if ((w->events & EPOLLIN)
+		&& (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)))
+		conn->flags.readable = 1;
+	    if ((w->events & EPOLLOUT)
+		&& (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)))
+		conn->flags.writable = 1;
+	    *tail = conn;
+	    tail = &conn->next_ready;
+	    break;
+
+	  case WATCH_SERVER:
+	    accept_clients((Server *) w->owner);
+	    break;
+
+	  case WATCH_PENDING:
+	    check_pending((Pending *) w->owner);
+	    break;
+
+	  case WATCH_DNS:
+	    /* handle_io_events() calls dns_deliver(). */
+	    break;
+	}
+	happened = 1;
+    }
+
+    *tail = NULL;
+    return happened;
+}
+
+#else
+
+void watch_connection(Connection *conn)
+{
+}
+
+void watch_server(Server *serv)
+{
+}
+
+void watch_pending(Pending *pend)
+{
+}
+
+void unwatch_fd(int fd)
+{
+}
+
+/* Wait for I/O events.  sec is the number of seconds we can wait before
+ * returning, or -1 if we can wait forever.  Ready connections are chained
+ * through next_ready onto *ready.  Returns nonzero if an I/O event
+ * happened. */
+int io_event_wait(long sec, Connection *connections, Server *servers,
+		  Pending *pendings, Connection **ready)
 {
     struct timeval tv, *tvp;
-    Connection *conn;
+    Connection *conn, **tail = ready;
     Server *serv;
     Pending *pend;
     fd_set read_fds, write_fds;
-    int flags, nfds, count, result, error, dummy = sizeof(int);
+    int nfds, count, fd;
+
+    *ready = NULL;
 
     /* Set time structure according to sec. */
     if (sec == -1) {
@@ -119,7 +480,7 @@ int io_event_wait(long sec, Connection *connections, Server *servers,
       int fd = conn->fd;
       if (!conn->flags.dead)
 	FD_SET(fd, &read_fds);
-      if (conn->write_buf && conn->write_buf->len) {
+      if (conn->out) {
 	FD_SET(fd, &write_fds);
       }
 
@@ -146,8 +507,15 @@ int io_event_wait(long sec, Connection *connections, Server *servers,
 	}
     }
 
+    /* Finished name lookups are signalled on a pipe. */
+    fd = dns_fd();
+    if (fd != -1) {
+	FD_SET(fd, &read_fds);
+	if (fd >= nfds)
+	    nfds = fd + 1;
+    }
+
     /* Call select(). */
-    count = rand();
     count = select(nfds, &read_fds, &write_fds, NULL, tvp);
 
     /* Lose horribly if select() fails on anything but an interrupted system
@@ -165,51 +533,31 @@ int io_event_wait(long sec, Connection *connections, Server *servers,
 	    conn->flags.readable = 1;
 	if (FD_ISSET(conn->fd, &write_fds))
 	    conn->flags.writable = 1;
+	if (conn->flags.readable || conn->flags.writable) {
+	    *tail = conn;
+	    tail = &conn->next_ready;
+	}
     }
+    *tail = NULL;
 
     /* Check if any server sockets have new connections. */
     for (serv = servers; serv; serv = serv->next) {
-	if (FD_ISSET(serv->server_socket, &read_fds)) {
-	    serv->client_socket = accept(serv->server_socket,
-					 (struct sockaddr *) &sockin, &addr_size);
-	    if (serv->client_socket < 0)
-		continue;
-
-	    /* Get address and local port of client. */
-	    strcpy(serv->client_addr, inet_ntoa(sockin.sin_addr));
-	    serv->client_port = ntohs(sockin.sin_port);
-
-	    /* Set the CLOEXEC flag on socket so that it will be closed for a
-	     * run_script() operation. */
-#ifdef FD_CLOEXEC
-	    flags = fcntl(serv->client_socket, F_GETFD);
-	    flags |= FD_CLOEXEC;
-	    fcntl(serv->client_socket, F_SETFD, flags);
-#endif
-	}
+	if (FD_ISSET(serv->server_socket, &read_fds))
+	    accept_clients(serv);
     }
 
     /* Check if any pending connections have succeeded or failed. */
     for (pend = pendings; pend; pend = pend->next) {
-	if (FD_ISSET(pend->fd, &write_fds)) {
-	    result = getpeername(pend->fd, (struct sockaddr *) &sockin,
-				 &addr_size);
-	    if (result == 0) {
-		pend->error = NOT_AN_IDENT;
-	    } else {
-		error = EOPNOTSUPP;  /* in case this is a unix domain */
-		getsockopt(pend->fd, SOL_SOCKET, SO_ERROR, (char *) &error,
-			   &dummy);
-		pend->error = translate_connect_error(error);
-	    }
-	    pend->finished = 1;
-	}
+	if (FD_ISSET(pend->fd, &write_fds))
+	    check_pending(pend);
     }
 
     /* Return nonzero, indicating that at least one I/O event occurred. */
     return 1;
 }
 
+#endif
+
 long non_blocking_iconnect(char *addr, int port, int *socket_return)
 {
   int fd, result, flags;
@@ -280,38 +628,6 @@ static long translate_connect_error(int error)
     }
 }
 
-String *hostname(char *chaddr)
-{
-   unsigned addr;
-   register struct hostent *hp;
-
-   addr = inet_addr(chaddr);
-   if (addr == -1)
-     return string_from_chars(chaddr, strlen(chaddr));
-
-   hp = gethostbyaddr((char *) &addr, 4, AF_INET);
-   if (hp)
-     return string_from_chars(hp->h_name, strlen(hp->h_name));
-   else
-     return string_from_chars(chaddr, strlen(chaddr));
-}
-
-String *ip(char *chaddr)
-{
-   unsigned addr;
-   register struct hostent *hp;
-
-   addr = inet_addr(chaddr);
-   if (addr == -1) {
-     hp = gethostbyname(chaddr);
-     if (hp)
-       return string_from_chars(inet_ntoa(*(struct in_addr *)hp->h_addr), strlen(inet_ntoa(*(struct in_addr *)hp->h_addr)));
-     else
-       return string_from_chars("-1", 2);
-   } else
-       return string_from_chars(chaddr, strlen(chaddr));
-}
-
 #if 0
 int get_server_usocket(char *path) 
 {
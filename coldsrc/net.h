@@ -6,12 +6,14 @@
 
 int get_server_socket(int port);
 int io_event_wait(long sec, Connection *connections, Server *servers,
-		  Pending *pendings);
+		  Pending *pendings, Connection **ready);
+void watch_connection(Connection *conn);
+void watch_server(Server *serv);
+void watch_pending(Pending *pend);
+void unwatch_fd(int fd);
 long non_blocking_iconnect(char *addr, int port, int *socket_return);
 long non_blocking_uconnect(char *addr, int *socket_return);
 long non_blocking_pconnect(char *addr, int *socket_return);
-String *hostname(char *addr);
-String *ip(char *addr);
 
 extern long server_failure_reason;
 
@@ -246,9 +246,16 @@ static List *unpackList(Buffer *fp, int *pc)
 
 static Buffer *packDict(Buffer *fp, Dict *dict)
 {
-  fp = packList(fp, dict->keys);
-  if (list_length(dict->keys))
-    fp = packList(fp, dict->values);
+  List *l;
+
+  l = dict_keys(dict);
+  fp = packList(fp, l);
+  list_discard(l);
+  if (dict_size(dict)) {
+    l = dict_values(dict);
+    fp = packList(fp, l);
+    list_discard(l);
+  }
 
   return fp;
 }
@@ -771,6 +778,9 @@ static Method *unpackMethod(Buffer *fp, int *pc)
 
   unpackM(fp, pc, method);
 
+  method->num_aggregates = 0;
+  method->aggregates = NULL;
+  method->loop_costs = NULL;
   method->refs = 1;
   return method;
 }
@@ -931,10 +941,14 @@ void op_pack()
 static int refTrans(Dict *trans)
 {
   Data *d;
+  Dict_entry *e;
   List *err = (List *)0;
 
   /* translate all dbrefs to local dbrefs in trans dictionary*/
-  for (d = list_first(trans->values); d; d = list_next(trans->values, d)) {
+  for (e = trans->entries; e < trans->entries + trans->num_entries; e++) {
+    if (e->key.type == NOT_AN_IDENT)
+      continue;
+    d = &e->value;
 
     /* find the dbref from the object name */
     Dbref dbref;
@@ -1082,7 +1096,7 @@ void op_unpack()
 
     /* add the list of referenced keys to the return value */
     external.type = LIST;
-    external.u.list = list_dup(refs->keys);
+    external.u.list = dict_keys(refs);
     returned = list_add(returned, &external);
 
     /* zero out the refs dictionary for next time */
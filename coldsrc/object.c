@@ -554,7 +554,7 @@ long object_del_param(Object *object, long name)
     /* This is the index-thread equivalent of double pointers in a standard
      * linked list.  We traverse the list using pointers to the ->next element
      * of the variables. */
-    indp = &object->vars.hashtab[hash(ident_name(name)) % object->vars.size];
+    indp = &object->vars.hashtab[ident_hash(name) % object->vars.size];
     for (; *indp != -1; indp = &object->vars.tab[*indp].next) {
 	var = &object->vars.tab[*indp];
 	if (var->name == name && var->cclass == object->dbref) {
@@ -670,7 +670,7 @@ static Var *object_create_var(Object *object, long cclass, long name)
 	for (i = 0; i < new_size; i++)
 	    object->vars.hashtab[i] = -1;
 	for (i = 0; i < object->vars.size; i++) {
-	    ind = hash(ident_name(object->vars.tab[i].name)) % new_size;
+	    ind = ident_hash(object->vars.tab[i].name) % new_size;
 	    object->vars.tab[i].next = object->vars.hashtab[ind];
 	    object->vars.hashtab[ind] = i;
 	}
@@ -697,7 +697,7 @@ static Var *object_create_var(Object *object, long cclass, long name)
     cnew->val.u.val = 0;
 
     /* Add variable to hash table thread. */
-    ind = hash(ident_name(name)) % object->vars.size;
+    ind = ident_hash(name) % object->vars.size;
     cnew->next = object->vars.hashtab[ind];
     object->vars.hashtab[ind] = cnew - object->vars.tab;
 
@@ -714,7 +714,7 @@ static Var *object_find_var(Object *object, long cclass, long name)
 
     assert(object_check(object));
     /* Traverse hash table thread, stopping if we get a match on the name. */
-    ind = object->vars.hashtab[hash(ident_name(name)) % object->vars.size];
+    ind = object->vars.hashtab[ident_hash(name) % object->vars.size];
     for (; ind != -1; ind = object->vars.tab[ind].next) {
 	var = &object->vars.tab[ind];
 	if (var->name == name && var->cclass == cclass) {
@@ -904,7 +904,7 @@ static Method *object_find_method_local(Object *object, long name)
     int ind, method;
 
     /* Traverse hash table thread, stopping if we get a match on the name. */
-    ind = hash(ident_name(name)) % object->methods.size;
+    ind = ident_hash(name) % object->methods.size;
     method = object->methods.hashtab[ind];
     for (; method != -1; method = object->methods.tab[method].next) {
       assert(ident_check(object->methods.tab[method].m->name));
@@ -976,7 +976,7 @@ void object_add_method(Object *object, long name, Method *method)
 	    object->methods.hashtab[i] = -1;
 	for (i = 0; i < object->methods.size; i++) {
 	  assert(ident_check(object->methods.tab[i].m->name));
-	    ind = hash(ident_name(object->methods.tab[i].m->name)) % new_size;
+	    ind = ident_hash(object->methods.tab[i].m->name) % new_size;
 	    object->methods.tab[i].next = object->methods.hashtab[ind];
 	    object->methods.hashtab[ind] = i;
 	}
@@ -1001,7 +1001,7 @@ void object_add_method(Object *object, long name, Method *method)
     object->methods.tab[ind].m = method_grab(method);
 
     /* Add method to hash table thread. */
-    hval = hash(ident_name(name)) % object->methods.size;
+    hval = ident_hash(name) % object->methods.size;
     object->methods.tab[ind].next = object->methods.hashtab[hval];
     object->methods.hashtab[hval] = ind;
 
@@ -1022,7 +1022,7 @@ int object_del_method(Object *object, long name)
     /* This is the index-thread equivalent of double pointers in a standard
      * linked list.  We traverse the list using pointers to the ->next element
      * of the method pointers. */
-    ind = hash(ident_name(name)) % object->methods.size;
+    ind = ident_hash(name) % object->methods.size;
     indp = &object->methods.hashtab[ind];
     for (; *indp != -1; indp = &object->methods.tab[*indp].next) {
 	ind = *indp;
@@ -1084,6 +1084,15 @@ void method_free(Method *method)
 	}
 	TFREE(method->error_lists, method->num_error_lists);
     }
+    if (method->num_aggregates) {
+	for (i = 0; i < method->num_aggregates; i++) {
+	    if (method->aggregates[i].type != NOT_AN_IDENT)
+		data_discard(&method->aggregates[i]);
+	}
+	free(method->aggregates);
+    }
+    if (method->loop_costs)
+	free(method->loop_costs);
     free(method);
 }
 
@@ -119,6 +119,11 @@ struct method {
     Error_list *error_lists;
     int overridable;
     int refs;
+    int num_aggregates;
+    Data *aggregates;		/* Constant literals and switch tables, built
+				 * on first use; see op_aggregate(). */
+    int *loop_costs;		/* Ticks per loop pass, by position of the
+				 * loop head; see charge_loop(). */
 };
 
 struct error_list {
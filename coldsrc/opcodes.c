@@ -72,6 +72,9 @@ Op_info op_info[] = {
     { CRITICAL_END,	"CRITICAL_END", 	op_critical_end },
     { PROPAGATE,	"PROPAGATE",		op_propagate, JUMP },
     { PROPAGATE_END,	"PROPAGATE_END",	op_propagate_end },
+    { AGGREGATE,	"AGGREGATE",		op_aggregate, JUMP, INTEGER },
+    { AGGREGATE_END,	"AGGREGATE_END",	op_aggregate_end, INTEGER },
+    { SWITCH_TABLE,	"SWITCH_TABLE",		op_switch_table, JUMP, INTEGER },
 
     /* Arithmetic and relational operators (arithop.c). */
     { '!',		"!",			op_not },
@@ -81,6 +84,7 @@ Op_info op_info[] = {
     { '%',		"%",			op_modulo },
     { '+',		"+",			op_add },
     { SPLICE_ADD,	"SPLICE_ADD",		op_splice_add },
+    { ADD_TAIL,	"ADD_TAIL",		op_add_tail, JUMP, INTEGER },
     { '-',		"-",			op_subtract },
     { EQ,		"EQ",			op_equal },
     { NE,		"NE",			op_not_equal },
@@ -114,6 +118,7 @@ Op_info op_info[] = {
     { MATCH_TEMPLATE,	"match_template",	op_match_template },
     { MATCH_PATTERN,	"match_pattern",	op_match_pattern },
     { MATCH_REGEXP,	"match_regexp",		op_match_regexp },
+    { REGEXP_STATS,	"regexp_stats",		op_regexp_stats },
     { CRYPT,		"crypt",		op_crypt },
     { UPPERCASE,	"uppercase",		op_uppercase },
     { LOWERCASE,	"lowercase",		op_lowercase },
@@ -175,6 +180,10 @@ Op_info op_info[] = {
 
     /* Input and output (ioop.c). */
     { ECHO_FUNC,	"echo",			op_echo },
+    { BROADCAST,	"broadcast",		op_broadcast },
+    { SET_OUTPUT_LIMITS, "set_output_limits",	op_set_output_limits },
+    { OUTPUT_STATS,	"output_stats",		op_output_stats },
+    { SET_LINE_MODE,	"set_line_mode",	op_set_line_mode },
     { ECHO_FILE,	"echo_file",		op_echo_file },
     { DISCONNECT,	"disconnect",		op_disconnect },
     { FILESTAT,		"filestat",		op_filestat },
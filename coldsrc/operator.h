@@ -56,6 +56,9 @@ void op_critical(void);
 void op_critical_end(void);
 void op_propagate(void);
 void op_propagate_end(void);
+void op_aggregate(void);
+void op_aggregate_end(void);
+void op_switch_table(void);
 
 /* Arithmetic and relational operators (arithop.c). */
 void op_not(void);
@@ -66,6 +69,7 @@ void op_divide(void);
 void op_modulo(void);
 void op_add(void);
 void op_splice_add(void);
+void op_add_tail(void);
 void op_subtract(void);
 void op_equal(void);
 void op_not_equal(void);
@@ -99,6 +103,7 @@ void op_match_begin(void);
 void op_match_template(void);
 void op_match_pattern(void);
 void op_match_regexp(void);
+void op_regexp_stats(void);
 void op_crypt(void);
 void op_uppercase(void);
 void op_lowercase(void);
@@ -160,6 +165,10 @@ void op_rethrow(void);
 
 /* Input and output (ioop.c). */
 void op_echo(void);
+void op_broadcast(void);
+void op_set_output_limits(void);
+void op_output_stats(void);
+void op_set_line_mode(void);
 void op_echo_file(void);
 void op_disconnect(void);
 void op_filestat(void);
@@ -26,7 +26,52 @@
 #define MALLOC_DELTA	(sizeof(String) + 32)
 #define STARTING_SIZE	(128 - MALLOC_DELTA)
 
+/* Strings no longer than INTERN_MAX which come from method literals or from
+ * the database are interned: identical ones share a single String, found
+ * through an open-addressed table whose size is a power of two.  The table
+ * doesn't hold a reference; a string leaves it when it is freed.  Interned
+ * strings are never modified in place, since others may find them later. */
+#define INTERN_MAX		32
+#define INTERN_START_SIZE	512
+
+/* Taking a substring of a shared string which runs to its end and is at least
+ * VIEW_MIN characters long gives a view: a String which shares its base's
+ * text (and its null terminator) instead of copying it.  A view holds a
+ * reference to its base, so the base is never modified in place while the
+ * view is around, and the view itself is copied before it is modified. */
+#define VIEW_MIN		64
+
 static String *prepare_to_modify(String *str, int start, int len);
+static void intern_grow(void);
+static void intern_remove(String *str);
+
+static String **intern_tab;
+static int intern_size, intern_count;
+
+/* Compiled regexps are kept in a cache of REGEXP_CACHE_SIZE entries, keyed by
+ * the text of their patterns, so that equal patterns compile once no matter
+ * which strings they come in.  When the cache is full, the least recently
+ * used entry makes way for a new one. */
+#define REGEXP_CACHE_SIZE	64
+#define REGEXP_HASH_SIZE	128
+
+typedef struct regexp_entry Regexp_entry;
+
+struct regexp_entry {
+    String *pattern;
+    unsigned long hval;		/* hash() of the pattern's text */
+    regexp *reg;
+    int next;			/* Next entry in the same hash chain. */
+    int older, newer;		/* Neighbours in order of last use. */
+};
+
+static void regexp_unlink(int i);
+static void regexp_link_newest(int i);
+
+static Regexp_entry regexp_cache[REGEXP_CACHE_SIZE];
+static int regexp_hash[REGEXP_HASH_SIZE];
+static int regexp_used, regexp_oldest = -1, regexp_newest = -1;
+static long regexp_hits, regexp_misses;
 
 #ifndef NDEBUG
 int string_check(String *s)
@@ -50,7 +95,9 @@ String *string_new(int size_needed)
     cnew->len = 0;
     cnew->size = size;
     cnew->refs = 1;
-    cnew->reg = NULL;
+    cnew->interned = 0;
+    cnew->base = NULL;
+    cnew->s = cnew->store;
     *cnew->s = 0;
     return cnew;
 }
@@ -65,6 +112,80 @@ String *string_from_chars(char *s, int len)
     return cnew;
 }
 
+/* Returns a string containing the len characters at s, sharing an existing
+ * string if it is short enough to be interned. */
+String *string_intern(char *s, int len)
+{
+    String *str;
+    int i, mask;
+
+    if (len > INTERN_MAX)
+	return string_from_chars(s, len);
+
+    if (intern_count * 3 >= intern_size * 2)
+	intern_grow();
+
+    mask = intern_size - 1;
+    for (i = hash_case(s, len) & mask; intern_tab[i]; i = (i + 1) & mask) {
+	str = intern_tab[i];
+	if (str->len == len && MEMCMP(str->s, s, len) == 0)
+	    return string_dup(str);
+    }
+
+    str = string_from_chars(s, len);
+    str->interned = 1;
+    intern_tab[i] = str;
+    intern_count++;
+    return str;
+}
+
+static void intern_grow(void)
+{
+    String **old_tab = intern_tab;
+    int old_size = intern_size, i, j, mask;
+
+    intern_size = (old_size) ? old_size * 2 : INTERN_START_SIZE;
+    intern_tab = EMALLOC(String *, intern_size);
+    for (i = 0; i < intern_size; i++)
+	intern_tab[i] = NULL;
+
+    mask = intern_size - 1;
+    for (i = 0; i < old_size; i++) {
+	if (!old_tab[i])
+	    continue;
+	j = hash_case(old_tab[i]->s, old_tab[i]->len) & mask;
+	while (intern_tab[j])
+	    j = (j + 1) & mask;
+	intern_tab[j] = old_tab[i];
+    }
+
+    if (old_tab)
+	free(old_tab);
+}
+
+static void intern_remove(String *str)
+{
+    String *moved;
+    int i, j, mask = intern_size - 1;
+
+    i = hash_case(str->s, str->len) & mask;
+    while (intern_tab[i] != str)
+	i = (i + 1) & mask;
+    intern_tab[i] = NULL;
+    intern_count--;
+
+    /* Put back the rest of the run, so that none of it is cut off from the
+     * slot its search starts at. */
+    for (i = (i + 1) & mask; intern_tab[i]; i = (i + 1) & mask) {
+	moved = intern_tab[i];
+	intern_tab[i] = NULL;
+	j = hash_case(moved->s, moved->len) & mask;
+	while (intern_tab[j])
+	    j = (j + 1) & mask;
+	intern_tab[j] = moved;
+    }
+}
+
 String *string_of_char(int c, int len)
 {
     String *cnew = string_new(len);
@@ -111,12 +232,17 @@ String *string_unpack(FILE *fp)
     String *str;
     int len;
     int result;
+    char buf[INTERN_MAX];
 
     len = read_long(fp);
     if (len == -1) {
       /*fprintf(stderr, "string_unpack: NULL @%d\n", ftell(fp));*/
       return NULL;
     }
+    if (len <= INTERN_MAX) {
+	result = fread(buf, sizeof(char), len, fp);
+	return string_intern(buf, len);
+    }
     str = string_new(len);
     str->len = len;
     result = fread(str->s, sizeof(char), len, fp);
@@ -136,6 +262,8 @@ int string_packed_size(String *str)
 int string_cmp(String *str1, String *str2)
 {
   assert((str1->refs > 0) && (str2->refs > 0));
+  if (str1 == str2)
+      return 0;
   return strcmp(str1->s + str1->start, str2->s + str2->start);
 }
 
@@ -200,6 +328,28 @@ String *string_truncate(String *str, int len)
 
 String *string_substring(String *str, int start, int len)
 {
+    String *view;
+
+    if ((str->refs > 1 || str->base) && start + len == str->len
+	&& len >= VIEW_MIN) {
+	if (str->refs == 1) {
+	    /* Narrow the view in place. */
+	    str->start += start;
+	    str->len = len;
+	    return str;
+	}
+	view = EMALLOC(String, 1);
+	view->start = str->start + start;
+	view->len = len;
+	view->refs = 1;
+	view->interned = 0;
+	view->base = string_dup(str->base ? str->base : str);
+	view->s = view->base->s;
+	view->size = view->base->size;
+	string_discard(str);
+	return view;
+    }
+
     str = prepare_to_modify(str, str->start + start, len);
     str->s[str->start + str->len] = 0;
 #ifndef NDEBUG
@@ -232,22 +382,105 @@ String *string_lowercase(String *str)
     return str;
 }
 
-/* Compile str's regexp, if it's not already compiled.  If there is an error,
- * it will be placed in regexp_error, and the returned regexp will be NULL. */
+/* Compile str's regexp, if one with the same pattern isn't already in the
+ * cache.  If there is an error, it will be placed in regexp_error, and the
+ * returned regexp will be NULL.  The regexp belongs to the cache, and stays
+ * valid until the next call. */
 regexp *string_regexp(String *str)
 {
-    if (!str->reg)
-	str->reg = regcomp(str->s + str->start);
-    return str->reg;
+    unsigned long hval;
+    regexp *reg;
+    int i, *ip;
+
+    if (!regexp_used) {
+	for (i = 0; i < REGEXP_HASH_SIZE; i++)
+	    regexp_hash[i] = -1;
+    }
+
+    hval = hash(string_chars(str));
+    for (i = regexp_hash[hval % REGEXP_HASH_SIZE]; i != -1;
+	 i = regexp_cache[i].next) {
+	if (regexp_cache[i].hval == hval
+	    && string_cmp(regexp_cache[i].pattern, str) == 0) {
+	    regexp_hits++;
+	    regexp_unlink(i);
+	    regexp_link_newest(i);
+	    return regexp_cache[i].reg;
+	}
+    }
+
+    regexp_misses++;
+    reg = regcomp(string_chars(str));
+    if (!reg)
+	return NULL;
+
+    if (regexp_used < REGEXP_CACHE_SIZE) {
+	i = regexp_used++;
+    } else {
+	/* Throw out the least recently used entry. */
+	i = regexp_oldest;
+	regexp_unlink(i);
+	ip = &regexp_hash[regexp_cache[i].hval % REGEXP_HASH_SIZE];
+	while (*ip != i)
+	    ip = &regexp_cache[*ip].next;
+	*ip = regexp_cache[i].next;
+	string_discard(regexp_cache[i].pattern);
+	free(regexp_cache[i].reg);
+    }
+
+    regexp_cache[i].pattern = string_dup(str);
+    regexp_cache[i].hval = hval;
+    regexp_cache[i].reg = reg;
+    regexp_cache[i].next = regexp_hash[hval % REGEXP_HASH_SIZE];
+    regexp_hash[hval % REGEXP_HASH_SIZE] = i;
+    regexp_link_newest(i);
+    return reg;
+}
+
+void string_regexp_stats(long *hits, long *misses, int *cached)
+{
+    *hits = regexp_hits;
+    *misses = regexp_misses;
+    *cached = regexp_used;
+}
+
+static void regexp_unlink(int i)
+{
+    Regexp_entry *entry = &regexp_cache[i];
+
+    if (entry->older != -1)
+	regexp_cache[entry->older].newer = entry->newer;
+    else
+	regexp_oldest = entry->newer;
+    if (entry->newer != -1)
+	regexp_cache[entry->newer].older = entry->older;
+    else
+	regexp_newest = entry->older;
+}
+
+static void regexp_link_newest(int i)
+{
+    regexp_cache[i].older = regexp_newest;
+    regexp_cache[i].newer = -1;
+    if (regexp_newest != -1)
+	regexp_cache[regexp_newest].newer = i;
+    else
+	regexp_oldest = i;
+    regexp_newest = i;
 }
 
 void string_discard(String *str)
 {
+    String *base;
+
     assert(str->refs > 0);
     if (!--str->refs) {
-	if (str->reg)
-	    free(str->reg);
+	if (str->interned)
+	    intern_remove(str);
+	base = str->base;
 	free(str);
+	if (base)
+	    string_discard(base);
     }
 }
 
@@ -329,7 +562,8 @@ static String *prepare_to_modify(String *str, int start, int len)
     need_to_resize = (len - start) * 4 < str->size;
     need_to_resize = need_to_resize && str->size > STARTING_SIZE;
     need_to_resize = need_to_resize || (str->size < len);
-    need_to_move = (str->refs > 1) || (need_to_resize && start > 0);
+    need_to_move = (str->refs > 1) || str->interned || str->base;
+    need_to_move = need_to_move || (need_to_resize && start > 0);
 
     if (need_to_move) {
 	/* Move the string's contents into a new list. */
@@ -345,13 +579,10 @@ static String *prepare_to_modify(String *str, int start, int len)
 	while (size < len)
 	    size = size * 2 + MALLOC_DELTA;
 	str = (String *)erealloc(str, sizeof(String) + (size * sizeof(char)));
+	str->s = str->store;
 	str->size = size;
 	return str;
     } else {
-	if (str->reg) {
-	    free(str->reg);
-	    str->reg = NULL;
-	}
 	str->start = start;
 	str->len = len;
 	return str;
@@ -343,6 +343,28 @@ void op_match_regexp(void)
     }
 }
 
+/* Return [hits, misses, cached] for the compiled regexp cache. */
+void op_regexp_stats(void)
+{
+    List *stats;
+    Data *d;
+    long hits, misses;
+    int cached;
+
+    if (!func_init_0())
+	return;
+
+    string_regexp_stats(&hits, &misses, &cached);
+    stats = list_new(3);
+    d = list_empty_spaces(stats, 3);
+    d[0].type = d[1].type = d[2].type = INTEGER;
+    d[0].u.val = hits;
+    d[1].u.val = misses;
+    d[2].u.val = cached;
+    push_list(stats);
+    list_discard(stats);
+}
+
 /* Encrypt a string. */
 void op_crypt(void)
 {
@@ -381,6 +403,7 @@ void op_uppercase(void)
     if (!func_init_1(&args, STRING))
 	return;
 
+    anticipate_assignment();
     args[0].u.str = string_uppercase(args[0].u.str);
 }
 
@@ -392,6 +415,7 @@ void op_lowercase(void)
     if (!func_init_1(&args, STRING))
 	return;
 
+    anticipate_assignment();
     args[0].u.str = string_lowercase(args[0].u.str);
 }
 
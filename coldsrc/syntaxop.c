@@ -16,15 +16,13 @@
 #include "lookup.h"
 #include "log.h"
 
+static Data *aggregate_slot(Method *method, int ind);
+static List *switch_table(Method *method, int pos);
+
 void op_comment(void)
 {
     /* Do nothing, just increment the program counter past the comment. */
     cur_frame->pc++;
-    /* actually, increment the number of ticks left too, since comments
-       really don't do anything */
-    cur_frame->ticks++;
-    /* decrement system tick */
-    tick--;
 }
 
 void op_pop(void)
@@ -87,6 +85,9 @@ void op_for_range(void)
     int var;
     Data *range;
 
+    if (charge_loop())
+	return;
+
     var = cur_frame->var_start + cur_frame->opcodes[cur_frame->pc + 1];
     range = &stack[stack_pos - 2];
 
@@ -121,6 +122,9 @@ void op_for_list(void)
     int var, len;
     List *pair;
 
+    if (charge_loop())
+	return;
+
     counter = &stack[stack_pos - 1];
     domain = &stack[stack_pos - 2];
     var = cur_frame->var_start + cur_frame->opcodes[cur_frame->pc + 1];
@@ -157,6 +161,9 @@ void op_for_list(void)
 
 void op_while(void)
 {
+    if (charge_loop())
+	return;
+
     if (!data_true(&stack[stack_pos - 1])) {
 	/* The condition expression is false.  Jump to the end of the loop. */
 	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
@@ -945,3 +952,137 @@ void op_propagate_end(void)
     pop_error_action_specifier();
 }
 
+
+void op_aggregate(void)
+{
+    Method *method = cur_frame->method;
+    int ind = cur_frame->opcodes[cur_frame->pc + 1];
+
+    /* If this constant list or dict has been built before, push the saved
+     * copy and skip the code which builds it.  Copy-on-write keeps the
+     * saved copy from being modified. */
+    if (ind < method->num_aggregates
+	&& method->aggregates[ind].type != NOT_AN_IDENT) {
+	push_data(&method->aggregates[ind]);
+	cur_frame->pc = cur_frame->opcodes[cur_frame->pc];
+    } else {
+	cur_frame->pc += 2;
+    }
+}
+
+void op_aggregate_end(void)
+{
+    int ind = cur_frame->opcodes[cur_frame->pc++];
+
+    /* Save a copy of the value we just built for op_aggregate(). */
+    data_dup(aggregate_slot(cur_frame->method, ind), &stack[stack_pos - 1]);
+}
+
+void op_switch_table(void)
+{
+    Method *method = cur_frame->method;
+    int ind = cur_frame->opcodes[cur_frame->pc + 1];
+    Data *table, *d, dest;
+
+    /* Build the dispatch table the first time through. */
+    if (ind >= method->num_aggregates
+	|| method->aggregates[ind].type == NOT_AN_IDENT) {
+	d = aggregate_slot(method, ind);
+	d->type = LIST;
+	d->u.list = switch_table(method, cur_frame->pc + 2);
+    }
+    table = list_first(method->aggregates[ind].u.list);
+
+    /* Pop the controlling expression and jump to the body of the matching
+     * case.  If there isn't one, leave it for the DEFAULT opcode. */
+    if (dict_find(table[0].u.dict, &stack[stack_pos - 1], &dest) == NOT_AN_IDENT) {
+	pop(1);
+	cur_frame->pc = dest.u.val;
+    } else {
+	cur_frame->pc = table[1].u.val;
+    }
+}
+
+/* Returns the aggregate slot ind in method, emptied and ready to be
+ * assigned. */
+static Data *aggregate_slot(Method *method, int ind)
+{
+    int i;
+
+    if (ind >= method->num_aggregates) {
+	method->aggregates = EREALLOC(method->aggregates, Data, ind + 1);
+	for (i = method->num_aggregates; i <= ind; i++)
+	    method->aggregates[i].type = NOT_AN_IDENT;
+	method->num_aggregates = ind + 1;
+    } else if (method->aggregates[ind].type != NOT_AN_IDENT) {
+	data_discard(&method->aggregates[ind]);
+    }
+    return &method->aggregates[ind];
+}
+
+/* Reads the cases of the switch statement whose first case begins at pos in
+ * method, which the code generator has checked are all integer, string or
+ * symbol literals.  Returns a list containing a dictionary mapping each case
+ * value to the start of its body, and the location of the DEFAULT opcode.
+ * Where a value appears twice, the first case wins, as it would if the cases
+ * were tried in order. */
+static List *switch_table(Method *method, int pos)
+{
+    long *opcodes = method->opcodes;
+    Dict *dict = dict_new_empty();
+    List *table;
+    Data key, dest, *d;
+
+    dest.type = INTEGER;
+    while (opcodes[pos] != DEFAULT) {
+	switch (opcodes[pos]) {
+	  case ZERO:
+	  case ONE:
+	    key.type = INTEGER;
+	    key.u.val = (opcodes[pos] == ONE);
+	    pos++;
+	    break;
+
+	  case INTEGER:
+	    key.type = INTEGER;
+	    key.u.val = opcodes[pos + 1];
+	    pos += 2;
+	    break;
+
+	  case STRING:
+	    key.type = STRING;
+	    key.u.str = object_get_string(method->object, opcodes[pos + 1]);
+	    pos += 2;
+	    break;
+
+	  case SYMBOL:
+	    key.type = SYMBOL;
+	    key.u.symbol = object_get_ident(method->object, opcodes[pos + 1]);
+	    pos += 2;
+	    break;
+
+	  default:
+	    panic("Invalid opcode in switch table.");
+	}
+
+	if (opcodes[pos] == CASE_VALUE) {
+	    dest.u.val = opcodes[pos + 1];
+	    pos += 2;
+	} else {
+	    /* LAST_CASE_VALUE: the body follows, and the next case is at its
+	     * jump argument. */
+	    dest.u.val = pos + 2;
+	    pos = opcodes[pos + 1];
+	}
+	if (!dict_contains(dict, &key))
+	    dict = dict_add(dict, &key, &dest);
+    }
+
+    table = list_new(2);
+    d = list_empty_spaces(table, 2);
+    d[0].type = DICT;
+    d[0].u.dict = dict;
+    d[1].type = INTEGER;
+    d[1].u.val = pos;
+    return table;
+}